@@ -30,7 +30,7 @@ bool is_bin_file(std::shared_ptr<datasource_t> source) {
     
     // Read the first 16 bytes to check for sync pattern
     auto header_block = source->read_block(0, 16);
-    uint8_t* header = static_cast<uint8_t*>(header_block.data());
+    const uint8_t* header = static_cast<const uint8_t*>(header_block.data());
     
     // Check for the standard sync pattern in the first 12 bytes
     for (size_t i = 0; i < CDROM_SYNC_PATTERN.size(); ++i) {
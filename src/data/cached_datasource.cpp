@@ -0,0 +1,107 @@
+#include "data/cached_datasource.h"
+#include <algorithm>
+#include <cstring>
+
+std::atomic<uint64_t> cached_datasource_t::total_hits_{0};
+std::atomic<uint64_t> cached_datasource_t::total_misses_{0};
+
+cached_datasource_t::cached_datasource_t(std::shared_ptr<datasource_t> source, size_t budget, size_t page_size)
+    : source_(std::move(source)), page_size_(page_size)
+{
+    if (page_size_ == 0)
+    {
+        throw std::invalid_argument("Cache page size cannot be zero");
+    }
+    max_pages_ = std::max<size_t>(1, budget / page_size_);
+}
+
+const block_t &cached_datasource_t::get_page(uint64_t page_index)
+{
+    auto it = pages_.find(page_index);
+    if (it != pages_.end())
+    {
+        total_hits_.fetch_add(1, std::memory_order_relaxed);
+        lru_.splice(lru_.begin(), lru_, it->second.lru_position);
+        return it->second.block;
+    }
+
+    total_misses_.fetch_add(1, std::memory_order_relaxed);
+
+    if (pages_.size() >= max_pages_)
+    {
+        pages_.erase(lru_.back());
+        lru_.pop_back();
+    }
+
+    uint64_t page_offset = page_index * page_size_;
+    uint64_t page_length = std::min<uint64_t>(page_size_, source_->size() - page_offset);
+
+    lru_.push_front(page_index);
+    auto inserted = pages_.emplace(page_index, page_t{source_->read_block(page_offset, page_length), lru_.begin()});
+    return inserted.first->second.block;
+}
+
+bool cached_datasource_t::bypasses_cache(uint64_t offset, uint64_t size) const
+{
+    uint64_t first_page = offset / page_size_;
+    uint64_t last_page = size ? (offset + size - 1) / page_size_ : first_page;
+
+    // Large reads (typically fork content) would only flush the metadata out of the cache
+    return last_page - first_page + 1 > std::max<size_t>(1, max_pages_ / 4);
+}
+
+void cached_datasource_t::copy_pages(uint64_t offset, uint64_t size, uint8_t *buffer)
+{
+    uint64_t done = 0;
+    while (done < size)
+    {
+        uint64_t page_index = (offset + done) / page_size_;
+        const block_t &page = get_page(page_index);
+        uint64_t offset_in_page = (offset + done) - page_index * page_size_;
+        uint64_t length = std::min<uint64_t>(page.size() - offset_in_page, size - done);
+        std::memcpy(buffer + done, static_cast<const uint8_t *>(page.data()) + offset_in_page, length);
+        done += length;
+    }
+}
+
+block_t cached_datasource_t::read_block(uint64_t offset, uint64_t size)
+{
+    if (offset + size > source_->size())
+    {
+        throw std::out_of_range("Read beyond end of cached source");
+    }
+
+    if (bypasses_cache(offset, size))
+    {
+        return source_->read_block(offset, size);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint64_t first_page = offset / page_size_;
+    if (size == 0 || (offset + size - 1) / page_size_ == first_page)
+    {
+        return get_page(first_page).sub_block(offset - first_page * page_size_, size);
+    }
+
+    // The read spans several pages, we need to assemble it
+    std::vector<uint8_t> data(size);
+    copy_pages(offset, size, data.data());
+    return block_t(std::move(data));
+}
+
+void cached_datasource_t::read_into(uint64_t offset, uint64_t size, uint8_t *buffer)
+{
+    if (offset + size > source_->size())
+    {
+        throw std::out_of_range("Read beyond end of cached source");
+    }
+
+    if (bypasses_cache(offset, size))
+    {
+        source_->read_into(offset, size, buffer);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    copy_pages(offset, size, buffer);
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "data/data.h"
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <memory>
+#include <unordered_map>
+
+// A data source that keeps recently read pages of another data source in memory
+// Pages are evicted in least-recently-used order once the byte budget is reached
+// Reads that fit in a single page are returned as views on the cached page (no copy)
+// Reads may come from several threads (ie: the hash pool), the pages are shared under a lock
+class cached_datasource_t : public datasource_t
+{
+    struct page_t
+    {
+        block_t block;
+        std::list<uint64_t>::iterator lru_position;
+    };
+
+    std::shared_ptr<datasource_t> source_;
+    size_t page_size_;
+    size_t max_pages_;
+    std::mutex mutex_;                            // Protects the pages of this source
+    std::list<uint64_t> lru_;                     // Page indexes, most recently used first
+    std::unordered_map<uint64_t, page_t> pages_; // Page index -> cached page
+
+    // Totals over all cached sources, for reporting
+    static std::atomic<uint64_t> total_hits_;
+    static std::atomic<uint64_t> total_misses_;
+
+    // Returns the page, reading it from the source if needed
+    const block_t &get_page(uint64_t page_index);
+
+    // True if the read is too large to go through the cache
+    bool bypasses_cache(uint64_t offset, uint64_t size) const;
+
+    // Copies a range that may span several pages into buffer
+    void copy_pages(uint64_t offset, uint64_t size, uint8_t *buffer);
+
+public:
+    // budget is the maximum number of bytes kept in memory, split in pages of page_size bytes
+    cached_datasource_t(std::shared_ptr<datasource_t> source, size_t budget, size_t page_size);
+
+    std::string description() const override
+    {
+        return source_->description();
+    }
+
+    uint64_t size() const override
+    {
+        return source_->size();
+    }
+
+    block_t read_block(uint64_t offset, uint64_t size) override;
+    void read_into(uint64_t offset, uint64_t size, uint8_t *buffer) override;
+
+    block_t read_block_uncached(uint64_t offset, uint64_t size) override
+    {
+        return source_->read_block_uncached(offset, size);
+    }
+
+    void prefetch(uint64_t offset, uint64_t size) override
+    {
+        source_->prefetch(offset, size);
+    }
+
+    std::string fingerprint() const override
+    {
+        return source_->fingerprint();
+    }
+
+    // Page lookups of all cached sources, served from memory / read from the underlying sources
+    static uint64_t total_hits() { return total_hits_; }
+    static uint64_t total_misses() { return total_misses_; }
+};
@@ -1,24 +1,53 @@
 #pragma once
 
 #include <vector>
+#include <cstring>
 #include <cstdint>
 #include <fstream>
 #include <stdexcept>
 #include <filesystem>
 #include <memory>
+#include <algorithm>
 #include "utils.h"
 
 // A block of continuous data
+// This is a read-only view (pointer + size) on a buffer that is kept alive by an owner handle
+// The owner can be a memory mapping, a cache page or a vector owned by the block itself,
+// so sources that can expose their bytes directly do not need to copy them
 class block_t
 {
-    std::vector<uint8_t> data_;
+    std::shared_ptr<const void> owner_; // Keeps the backing buffer alive
+    const uint8_t *data_;
+    size_t size_;
 
 public:
-    block_t(const std::vector<uint8_t> &data) : data_(data) {}
+    // Takes ownership of a buffer (for sources that must assemble their data)
+    block_t(std::vector<uint8_t> data)
+    {
+        auto buffer = std::make_shared<const std::vector<uint8_t>>(std::move(data));
+        data_ = buffer->data();
+        size_ = buffer->size();
+        owner_ = std::move(buffer);
+    }
+
+    // View into memory kept alive by owner
+    block_t(std::shared_ptr<const void> owner, const uint8_t *data, size_t size)
+        : owner_(std::move(owner)), data_(data), size_(size) {}
+
+    const void *data() const { return data_; }
+    size_t size() const { return size_; }
+
+    // A view on a part of this block, sharing the same owner
+    block_t sub_block(size_t offset, size_t size) const
+    {
+        if (offset + size > size_)
+        {
+            throw std::out_of_range("Sub-block beyond end of block");
+        }
+        return block_t(owner_, data_ + offset, size);
+    }
 
-    void *data() { return data_.data(); }
-    size_t size() const { return data_.size(); }
-    void dump() const { ::dump(data_); }
+    void dump() const { ::dump(data_, size_); }
 };
 
 //  The interface to a data source
@@ -29,6 +58,29 @@ public:
     virtual ~datasource_t() = default;
     virtual block_t read_block(uint64_t offset, uint64_t size) = 0;
     virtual uint64_t size() const = 0;
+
+    // Copies size bytes at offset into buffer
+    // Sources that assemble their data can override this to write straight into the caller's buffer
+    virtual void read_into(uint64_t offset, uint64_t size, uint8_t *buffer)
+    {
+        block_t block = read_block(offset, size);
+        std::memcpy(buffer, block.data(), size);
+    }
+
+    // Reads a block without keeping it in any cache, for large one-shot scans
+    // that would otherwise evict the pages that keyed lookups rely on
+    virtual block_t read_block_uncached(uint64_t offset, uint64_t size)
+    {
+        return read_block(offset, size);
+    }
+
+    // Hints that a range will be read soon, so the source can start fetching it without waiting
+    // Ranges beyond the end of the source are ignored
+    virtual void prefetch(uint64_t, uint64_t) {}
+
+    // Identifies the version of the underlying file: it changes when the file is modified or replaced
+    // Empty if the source cannot tell, in which case nothing read from it should be cached across runs
+    virtual std::string fingerprint() const { return ""; }
 };
 
 class file_datasource_t : public datasource_t
@@ -76,7 +128,7 @@ public:
             throw std::runtime_error("Error reading from file");
         }
 
-        return block_t(data);
+        return block_t(std::move(data));
     }
 };
 
@@ -114,4 +166,35 @@ public:
         }
         return source_->read_block(offset + offset_, size);
     }
+
+    void read_into(uint64_t offset, uint64_t size, uint8_t *buffer) override
+    {
+        if (offset + size > size_)
+        {
+            throw std::out_of_range("Read beyond end of range");
+        }
+        source_->read_into(offset + offset_, size, buffer);
+    }
+
+    block_t read_block_uncached(uint64_t offset, uint64_t size) override
+    {
+        if (offset + size > size_)
+        {
+            throw std::out_of_range("Read beyond end of range");
+        }
+        return source_->read_block_uncached(offset + offset_, size);
+    }
+
+    void prefetch(uint64_t offset, uint64_t size) override
+    {
+        if (offset < size_)
+        {
+            source_->prefetch(offset + offset_, std::min(size, size_ - offset));
+        }
+    }
+
+    std::string fingerprint() const override
+    {
+        return source_->fingerprint();
+    }
 };
@@ -0,0 +1,113 @@
+#include "data/mmap_datasource.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+
+// Boot blocks, MDB and partition map all live in the first few KB of an image
+// We ask the kernel to fault them in right away, as every detector will read them
+static const uint64_t HEADER_PREFETCH_SIZE = 64 * 1024;
+
+mmap_datasource_t::mmap_datasource_t(const std::filesystem::path &file_path)
+    : fd_(-1), size_(0), description_(file_path.string())
+{
+    fd_ = ::open(file_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd_ < 0)
+    {
+        throw std::runtime_error("Cannot open file: " + file_path.string());
+    }
+
+    struct stat st;
+    if (::fstat(fd_, &st) != 0)
+    {
+        ::close(fd_);
+        throw std::runtime_error("Cannot stat file: " + file_path.string());
+    }
+    size_ = static_cast<uint64_t>(st.st_size);
+
+    if (S_ISREG(st.st_mode))
+    {
+        fingerprint_ = std::format("{}:{}:{}:{}.{:09}", st.st_dev, st.st_ino, st.st_size, st.st_mtim.tv_sec, st.st_mtim.tv_nsec);
+    }
+
+    if (size_ == 0 || !S_ISREG(st.st_mode))
+    {
+        return; // Nothing to map, reads will go through pread()
+    }
+
+    void *base = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+    if (base == MAP_FAILED)
+    {
+        rs_log("mmap failed for {}: {}, falling back to pread", description_, std::strerror(errno));
+        return;
+    }
+    uint64_t length = size_;
+    mapping_ = std::shared_ptr<const uint8_t>(static_cast<const uint8_t *>(base),
+                                              [length](const uint8_t *p)
+                                              { ::munmap(const_cast<uint8_t *>(p), length); });
+
+    prefetch(0, HEADER_PREFETCH_SIZE);
+}
+
+mmap_datasource_t::~mmap_datasource_t()
+{
+    if (fd_ >= 0)
+    {
+        ::close(fd_);
+    }
+}
+
+void mmap_datasource_t::prefetch(uint64_t offset, uint64_t size)
+{
+    if (offset >= size_ || size == 0)
+    {
+        return;
+    }
+    size = std::min(size, size_ - offset);
+
+    if (!mapping_)
+    {
+        ::posix_fadvise(fd_, offset, size, POSIX_FADV_WILLNEED);
+        return;
+    }
+
+    // madvise needs a page aligned address
+    static const uint64_t page_size = ::sysconf(_SC_PAGESIZE);
+    uint64_t start = offset - offset % page_size;
+    ::madvise(const_cast<uint8_t *>(mapping_.get()) + start, offset + size - start, MADV_WILLNEED);
+}
+
+block_t mmap_datasource_t::read_block(uint64_t offset, uint64_t size)
+{
+    if (offset > size_ || size > size_ - offset)
+    {
+        throw std::out_of_range("Read beyond end of file");
+    }
+
+    if (mapping_)
+    {
+        return block_t(mapping_, mapping_.get() + offset, size);
+    }
+
+    std::vector<uint8_t> data(size);
+    uint64_t done = 0;
+    while (done < size)
+    {
+        ssize_t n = ::pread(fd_, data.data() + done, size - done, offset + done);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            throw std::runtime_error("Error reading from file");
+        }
+        done += static_cast<uint64_t>(n);
+    }
+
+    return block_t(std::move(data));
+}
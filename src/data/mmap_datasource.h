@@ -0,0 +1,49 @@
+#pragma once
+
+#include "data/data.h"
+#include <filesystem>
+
+// A data source backed by a read-only memory mapping of a disk image file
+// Reads resolve to pointer arithmetic into the mapping instead of seek+read calls,
+// and the returned blocks are views that keep the mapping alive
+// If the file cannot be mapped (empty file, special file, mmap failure), reads fall back to pread()
+class mmap_datasource_t : public datasource_t
+{
+private:
+    int fd_;                               // File descriptor (kept open for the pread fallback)
+    std::shared_ptr<const uint8_t> mapping_; // The mapping (unmapped with the last block), nullptr if not mapped
+    uint64_t size_;                        // Size of the file in bytes
+    std::string description_;              // File path
+    std::string fingerprint_;              // Device, inode, size and modification time of the file
+
+public:
+    mmap_datasource_t(const std::filesystem::path &file_path);
+    ~mmap_datasource_t();
+
+    mmap_datasource_t(const mmap_datasource_t &) = delete;
+    mmap_datasource_t &operator=(const mmap_datasource_t &) = delete;
+
+    std::string description() const override
+    {
+        return description_;
+    }
+
+    uint64_t size() const override
+    {
+        return size_;
+    }
+
+    block_t read_block(uint64_t offset, uint64_t size) override;
+
+    // Asks the kernel to start reading the pages of the range
+    void prefetch(uint64_t offset, uint64_t size) override;
+
+    // Empty for special files, whose content can change without notice
+    std::string fingerprint() const override
+    {
+        return fingerprint_;
+    }
+
+    // True if reads are served from the memory mapping
+    bool is_mapped() const { return mapping_ != nullptr; }
+};
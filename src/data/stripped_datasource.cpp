@@ -1,5 +1,6 @@
 #include "data/stripped_datasource.h"
 #include <algorithm>
+#include <cstring>
 
 stripped_datasource_t::stripped_datasource_t(std::shared_ptr<datasource_t> source, 
                                                size_t sector_size, 
@@ -19,50 +20,62 @@ stripped_datasource_t::stripped_datasource_t(std::shared_ptr<datasource_t> sourc
     }
 }
 
-std::vector<uint8_t> stripped_datasource_t::read(uint64_t offset, uint64_t length) const {
-    if (offset >= total_data_size_) {
-        return {};
-    }
-    
-    length = std::min(length, total_data_size_ - offset);
-    std::vector<uint8_t> result;
-    result.reserve(length);
-    
-    uint64_t bytes_read = 0;
-    uint64_t current_offset = offset;
-    
-    while (bytes_read < length) {
-        // Find which sector this offset belongs to
-        uint64_t sector_index = current_offset / data_bytes_;
-        uint64_t offset_in_sector = current_offset % data_bytes_;
-        
-        // Calculate source offset for this sector
-        uint64_t source_offset = sector_index * sector_size_ + skip_bytes_ + offset_in_sector;
-        
-        // How much to read from this sector
-        uint16_t bytes_in_this_sector = std::min((uint64_t)(data_bytes_ - offset_in_sector), length - bytes_read);
-        
-        // Read from source
-        auto sector_block = source_->read_block(source_offset, bytes_in_this_sector);
-        uint8_t* sector_data = static_cast<uint8_t*>(sector_block.data());
-        result.insert(result.end(), sector_data, sector_data + bytes_in_this_sector);
-        
-        bytes_read += bytes_in_this_sector;
-        current_offset += bytes_in_this_sector;
-        
-        // If we couldn't read the full requested amount, we've hit the end
-        if (bytes_in_this_sector < (data_bytes_ - offset_in_sector) && bytes_read < length) {
-            break;
+void stripped_datasource_t::read(uint64_t offset, uint64_t length, uint8_t *out) const {
+    uint64_t end = offset + length;
+
+    while (offset < end) {
+        // Fetch a run of raw sectors in one underlying read
+        uint64_t first_sector = offset / data_bytes_;
+        uint64_t last_sector = std::min((end - 1) / data_bytes_, first_sector + SECTORS_PER_READ - 1);
+        uint64_t run_end = std::min(end, (last_sector + 1) * data_bytes_);
+
+        uint64_t raw_start = first_sector * sector_size_ + skip_bytes_ + offset % data_bytes_;
+        uint64_t raw_end = last_sector * sector_size_ + skip_bytes_ + (run_end - last_sector * data_bytes_);
+        auto raw_block = source_->read_block(raw_start, raw_end - raw_start);
+        const uint8_t *raw = static_cast<const uint8_t *>(raw_block.data());
+
+        // De-interleave the payloads: the first one may start mid-sector,
+        // then each sector contributes data_bytes_ every sector_size_ raw bytes
+        while (offset < run_end) {
+            uint64_t offset_in_sector = offset % data_bytes_;
+            uint64_t bytes_in_this_sector = std::min(data_bytes_ - offset_in_sector, run_end - offset);
+            std::memcpy(out, raw, bytes_in_this_sector);
+            out += bytes_in_this_sector;
+            offset += bytes_in_this_sector;
+            raw += bytes_in_this_sector + (sector_size_ - data_bytes_);
         }
     }
-    
-    return result;
 }
 
 block_t stripped_datasource_t::read_block(uint64_t offset, uint64_t length) {
-    return block_t(read(offset, length));
+    if (offset + length > total_data_size_) {
+        throw std::out_of_range("Read beyond end of stripped data");
+    }
+
+    std::vector<uint8_t> result(length);
+    read(offset, length, result.data());
+    return block_t(std::move(result));
+}
+
+void stripped_datasource_t::read_into(uint64_t offset, uint64_t length, uint8_t *buffer) {
+    if (offset + length > total_data_size_) {
+        throw std::out_of_range("Read beyond end of stripped data");
+    }
+
+    read(offset, length, buffer);
 }
 
 uint64_t stripped_datasource_t::size() const {
     return total_data_size_;
-}
\ No newline at end of file
+}
+
+void stripped_datasource_t::prefetch(uint64_t offset, uint64_t length) {
+    if (offset >= total_data_size_ || length == 0) {
+        return;
+    }
+    length = std::min<uint64_t>(length, total_data_size_ - offset);
+
+    uint64_t first_sector = offset / data_bytes_;
+    uint64_t last_sector = (offset + length - 1) / data_bytes_;
+    source_->prefetch(first_sector * sector_size_, (last_sector - first_sector + 1) * sector_size_);
+}
@@ -26,9 +26,22 @@ public:
     }
 
     block_t read_block(uint64_t offset, uint64_t length) override;
+    void read_into(uint64_t offset, uint64_t length, uint8_t *buffer) override;
     uint64_t size() const override;
 
+    // Prefetches the raw sectors holding the range
+    void prefetch(uint64_t offset, uint64_t length) override;
+
+    std::string fingerprint() const override
+    {
+        return source_->fingerprint();
+    }
+
 private:
-    // Helper method for easier reading
-    std::vector<uint8_t> read(uint64_t offset, uint64_t length) const;
+    // Maximum number of raw sectors fetched from the source in a single read
+    static const uint64_t SECTORS_PER_READ = 256;
+
+    // Reads length bytes of stripped data at offset directly into out
+    // The range must be within the stripped data
+    void read(uint64_t offset, uint64_t length, uint8_t *out) const;
 };
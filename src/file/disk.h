@@ -1,14 +1,22 @@
 #pragma once
 
 #include <string>
+#include <string_view>
+#include "utils/string_arena.h"
 
 class Disk
 {
 	std::string name_;
 	std::string path_;
+	std::string fingerprint_;
+	string_arena_t names_;
 
 public:
-	Disk(const std::string &name, const std::string &path) : name_(name), path_(path) {}
+	Disk(const std::string &name, const std::string &path, const std::string &fingerprint) : name_(name), path_(path), fingerprint_(fingerprint) {}
 	const std::string &name() const { return name_; }
 	const std::string &path() const { return path_; }
+	// Version of the image file the disk was read from (see datasource_t::fingerprint)
+	const std::string &fingerprint() const { return fingerprint_; }
+	// Keep a name of a file of the disk, it lives as long as the disk (see File::name)
+	std::string_view intern(std::string_view name) { return names_.store(name); }
 };
\ No newline at end of file
@@ -1,113 +1,105 @@
 #include "file/file.h"
 #include "file/folder.h"
 #include "utils.h"
-#include "utils/md5.h"
+#include "utils/hasher.h"
+#include "utils/md5_multi.h"
 #include "rsrc/rsrc_parser.h"
+#include "file/disk.h"
+#include "utils/hash_cache.h"
 
 #include <iostream>
 #include <stdexcept>
 
 namespace {
 
-// Extract clean resource fork data (header + data + map) from parser, skipping padding
-static std::string extract_clean_rsrc_data_old(const rsrc_parser_t& parser, const std::vector<uint8_t>& rsrc)
+// Hash clean resource fork data (header + data + map) from parser, skipping padding
+static void hash_clean_rsrc_data_old(const rsrc_parser_t& parser, const std::vector<uint8_t>& rsrc, hasher_t& hasher)
 {
     if (!parser.is_valid()) {
         // If parser is invalid, fall back to hashing the entire fork
-        return std::string(rsrc.begin(), rsrc.end());
+        hasher.update(rsrc.data(), rsrc.size());
+        return;
     }
 
-    // Only extract the actual resource data and map, skipping the padding
+    // Only hash the actual resource data and map, skipping the padding
     uint32_t data_offset = parser.get_data_offset();
     uint32_t data_length = parser.get_data_length();
     uint32_t map_offset = parser.get_map_offset();
     uint32_t map_length = parser.get_map_length();
     
-    // Create a string with just the header + data + map (no padding)
-    std::string clean_rsrc;
-    
     // Add header (first 16 bytes)
     if (rsrc.size() >= 16) {
-        clean_rsrc.append(rsrc.begin(), rsrc.begin() + 16);
+        hasher.update(rsrc.data(), 16);
     }
     
     // Add resource data (skip padding, go directly to data)
     if (data_offset + data_length <= rsrc.size()) {
-        clean_rsrc.append(rsrc.begin() + data_offset, rsrc.begin() + data_offset + data_length);
+        hasher.update(rsrc.data() + data_offset, data_length);
     }
     
     // Add resource map
     if (map_offset + map_length <= rsrc.size()) {
-        clean_rsrc.append(rsrc.begin() + map_offset, rsrc.begin() + map_offset + map_length);
+        hasher.update(rsrc.data() + map_offset, map_length);
     }
-    
-    return clean_rsrc;
 }
 
-// Extract resource fork data in canonical order (resources sorted by type, then by ID)
-static std::string extract_clean_rsrc_data(const rsrc_parser_t& parser, const std::vector<uint8_t>& rsrc)
+// Hash resource fork data in canonical order (resources sorted by type, then by ID)
+static void hash_clean_rsrc_data(const rsrc_parser_t& parser, const std::vector<uint8_t>& rsrc, hasher_t& hasher)
 {
     if (!parser.is_valid()) {
         // If parser is invalid, fall back to hashing the entire fork
-        return std::string(rsrc.begin(), rsrc.end());
+        hasher.update(rsrc.data(), rsrc.size());
+        return;
     }
 
+    // Nothing is hashed before all resources are parsed, so a failure can fall back to the old method
+    std::vector<rsrc_t> resources;
     try {
-        // Get all resources from the parser
-        auto resources = parser.get_resources();
-        
-        // Sort resources by type first, then by ID within each type
-        std::sort(resources.begin(), resources.end(), [](const auto& a, const auto& b) {
-            if (a.type() != b.type()) {
-                return a.type() < b.type();
-            }
-            return a.id() < b.id();
-        });
+        resources = parser.get_resources();
+    } catch (const std::exception& e) {
+        hash_clean_rsrc_data_old(parser, rsrc, hasher);
+        return;
+    }
+
+    // Sort resources by type first, then by ID within each type
+    std::sort(resources.begin(), resources.end(), [](const auto& a, const auto& b) {
+        if (a.type() != b.type()) {
+            return a.type() < b.type();
+        }
+        return a.id() < b.id();
+    });
+    
+    for (const auto& resource : resources) {
+        // Resource type (4 bytes), ID (4 bytes, big-endian, padded), name length + name
+        std::string header = resource.type();
+        int16_t id = resource.id();
+        header.push_back(static_cast<char>((id >> 8) & 0xFF));
+        header.push_back(static_cast<char>(id & 0xFF));
+        header.push_back(0); // padding
+        header.push_back(0); // padding
+        std::string name = resource.name();
+        header.push_back(static_cast<char>(name.length()));
+        header.append(name);
         
-        // Create canonical string representation
-        std::string canonical_rsrc;
+        // Resource data size (4 bytes, big-endian)
+        uint32_t size = resource.size();
+        header.push_back(static_cast<char>((size >> 24) & 0xFF));
+        header.push_back(static_cast<char>((size >> 16) & 0xFF));
+        header.push_back(static_cast<char>((size >> 8) & 0xFF));
+        header.push_back(static_cast<char>(size & 0xFF));
+        hasher.update(header.data(), header.size());
         
-        for (const auto& resource : resources) {
-            // Add resource type (4 bytes)
-            std::string type = resource.type();
-            canonical_rsrc.append(type);
-            
-            // Add resource ID (4 bytes, big-endian)
-            int16_t id = resource.id();
-            canonical_rsrc.push_back(static_cast<char>((id >> 8) & 0xFF));
-            canonical_rsrc.push_back(static_cast<char>(id & 0xFF));
-            canonical_rsrc.push_back(0); // padding
-            canonical_rsrc.push_back(0); // padding
-            
-            // Add resource name length + name
-            std::string name = resource.name();
-            canonical_rsrc.push_back(static_cast<char>(name.length()));
-            canonical_rsrc.append(name);
-            
-            // Add resource data size (4 bytes, big-endian)
-            uint32_t size = resource.size();
-            canonical_rsrc.push_back(static_cast<char>((size >> 24) & 0xFF));
-            canonical_rsrc.push_back(static_cast<char>((size >> 16) & 0xFF));
-            canonical_rsrc.push_back(static_cast<char>((size >> 8) & 0xFF));
-            canonical_rsrc.push_back(static_cast<char>(size & 0xFF));
-            
-            // Add actual resource data
-            try {
-                auto data = resource.data();
-                if (data && !data->empty()) {
-                    canonical_rsrc.append(data->begin(), data->end());
-                }
-            } catch (const std::exception& e) {
-                // If we can't read the resource data, add a placeholder
-                canonical_rsrc.append("ERROR_READING_RESOURCE_DATA");
+        // Actual resource data
+        try {
+            auto data = resource.data();
+            if (data && !data->empty()) {
+                hasher.update(data->data(), data->size());
             }
+        } catch (const std::exception& e) {
+            // If we can't read the resource data, add a placeholder
+            static const std::string placeholder = "ERROR_READING_RESOURCE_DATA";
+            hasher.update(placeholder.data(), placeholder.size());
         }
-        
-        return canonical_rsrc;
-        
-    } catch (const std::exception& e) {
-        // If we can't get resources, fall back to old method
-        return extract_clean_rsrc_data_old(parser, rsrc);
     }
 }
 
@@ -119,22 +111,36 @@ static std::string extract_clean_rsrc_data(const rsrc_parser_t& parser, const st
 static int sFileCount = 0;
 #endif
 
-File::File(const std::shared_ptr<Disk> &disk, const std::string &name, const std::string &type,
-           const std::string &creator, 
-           std::unique_ptr<fork_t> data_fork,
-           std::unique_ptr<fork_t> rsrc_fork)
-    : disk_(disk), name_(name), sane_name_(sanitize_string(name)), type_(type), creator_(creator),
+File::File(const std::shared_ptr<Disk> &disk, std::string_view name, uint32_t type,
+           uint32_t creator, uint32_t id,
+           fork_t *data_fork,
+           fork_t *rsrc_fork)
+    : disk_(disk), name_(disk->intern(name)), sane_name_(name_), type_(type), creator_(creator), id_(id),
       data_size_(data_fork ? data_fork->size() : 0), 
       rsrc_size_(rsrc_fork ? rsrc_fork->size() : 0), 
       parent_(nullptr),
-      data_fork_(std::move(data_fork)), 
-      rsrc_fork_(std::move(rsrc_fork))
+      data_fork_(data_fork), 
+      rsrc_fork_(rsrc_fork)
 {
+    auto sane_name = sanitize_string(std::string(name));
+    if (sane_name != name) {
+        sane_name_ = disk_->intern(sane_name);
+    }
 #ifdef DEBUG_MEMORY
     sFileCount++;
 #endif
 }
 
+std::string File::type() const
+{
+    return string_from_code(type_);
+}
+
+std::string File::creator() const
+{
+    return string_from_code(creator_);
+}
+
 File::~File()
 {
 #ifdef DEBUG_MEMORY
@@ -144,27 +150,13 @@ File::~File()
 #endif
 }
 
-void File::retain_folder()
-{
-    if (parent_)
-    {
-        retained_folder_ = parent_->shared_from_this();
-        retained_folder_->retain_folder();
-    }
-}
-
-std::vector<std::shared_ptr<Folder>> File::retained_path() const
+std::vector<Folder *> File::path() const
 {
-    std::vector<std::shared_ptr<Folder>> result;
-    if (retained_folder_)
-    {
-        auto f = retained_folder_;
-        while (f)
-        {
-            result.push_back(f);
-            f = f->retained_folder();
-        }
+    if (!parent_) {
+        return {};
     }
+    auto result = parent_->path();
+    result.push_back(parent_);
     return result;
 }
 
@@ -192,32 +184,142 @@ std::vector<uint8_t> File::read_rsrc(uint32_t offset, uint32_t size)
 
 std::string File::content_key() const
 {
-    // Calculate MD5 of data fork
-    std::string data_md5 = "0";  // Default for empty data fork
+    // Hash the data fork, streamed from the fork
+    std::string data_hash = "0";  // Default for empty data fork
     if (data_size_ > 0) {
         try {
-            auto data = read_data_all();
-            if (!data.empty()) {
-                std::string data_str(data.begin(), data.end());
-                data_md5 = MD5(data_str).toStr();
-            }
+            data_hash = cached_fork_hash('D', data_size_, [this] {
+                auto hasher = make_hasher(gContentHash);
+                return data_fork_->hash(*hasher) ? hasher->digest() : std::string("0");
+            });
         } catch (const std::exception& e) {
             // If we can't read the data, use a hash based on the error
-            data_md5 = std::format("error_{}", data_size_);
+            data_hash = std::format("error_{}", data_size_);
         }
     }
-    
-    // Calculate MD5 of resource fork
-    std::string rsrc_md5 = calculate_rsrc_md5();
+    return content_key(data_hash);
+}
+
+std::string File::content_key(const std::string &data_hash) const
+{
+    // Hash the resource fork
+    std::string rsrc_hash = rsrc_size_ > 0 ? cached_fork_hash('R', rsrc_size_, [this] { return calculate_rsrc_hash(); }) : "0";
     
     // Return enhanced key with content hashes (name excluded for content comparison)
     std::string key = std::format("{}|{}|{}|{}|{}|{}", 
-                       type_, creator_, data_size_, rsrc_size_, data_md5, rsrc_md5);
+                       type(), creator(), data_size_, rsrc_size_, data_hash, rsrc_hash);
     
     return key;
 }
 
-std::string File::calculate_rsrc_md5() const
+std::vector<std::string> File::content_keys(const std::vector<std::shared_ptr<File>> &files)
+{
+    std::vector<std::string> keys;
+    if (gContentHash != hash_algorithm_t::md5) {
+        for (const auto &file : files) {
+            keys.push_back(file->content_key());
+        }
+        return keys;
+    }
+
+    // The data forks that are not empty nor cached are hashed lanes() at a time
+    std::vector<std::string> data_hashes(files.size(), "0");
+    std::vector<size_t> hashed;
+    for (size_t i = 0; i != files.size(); i++) {
+        if (files[i]->data_size_ > 0 && !files[i]->find_cached_hash('D', files[i]->data_size_, data_hashes[i])) {
+            hashed.push_back(i);
+        }
+    }
+    // Forks of the same size keep all the lanes busy until they end
+    std::stable_sort(hashed.begin(), hashed.end(), [&files](size_t a, size_t b) { return files[a]->data_size_ < files[b]->data_size_; });
+
+    for (size_t first = 0; first < hashed.size(); first += md5_multi_t::lanes()) {
+        size_t count = std::min(md5_multi_t::lanes(), hashed.size() - first);
+        md5_multi_t md5(count);
+        std::vector<uint32_t> offsets(count);
+        std::vector<bool> done(count), failed(count);
+
+        // A chunk of each fork per round, like fork_t::hash, so the lanes advance together
+        for (size_t active = count; active > 0; ) {
+            for (size_t lane = 0; lane != count; lane++) {
+                if (done[lane]) {
+                    continue;
+                }
+                auto &fork = *files[hashed[first + lane]]->data_fork_;
+                try {
+                    auto chunk = offsets[lane] < fork.size() ? fork.read(offsets[lane], std::min(fork_t::hash_chunk_size, fork.size() - offsets[lane])) : std::vector<uint8_t>();
+                    md5.update(lane, chunk.data(), chunk.size());
+                    offsets[lane] += static_cast<uint32_t>(chunk.size());
+                    done[lane] = chunk.empty();
+                } catch (const std::exception& e) {
+                    done[lane] = failed[lane] = true;
+                }
+                active -= done[lane];
+            }
+            md5.flush();
+        }
+
+        auto digests = md5.digests();
+        for (size_t lane = 0; lane != count; lane++) {
+            auto &file = *files[hashed[first + lane]];
+            if (failed[lane]) {
+                // Same as content_key(), errors are not cached
+                data_hashes[hashed[first + lane]] = std::format("error_{}", file.data_size_);
+                continue;
+            }
+            data_hashes[hashed[first + lane]] = offsets[lane] ? digests[lane] : "0";
+            file.add_cached_hash('D', file.data_size_, data_hashes[hashed[first + lane]]);
+        }
+    }
+
+    for (size_t i = 0; i != files.size(); i++) {
+        keys.push_back(files[i]->content_key(data_hashes[i]));
+    }
+    return keys;
+}
+
+std::string File::cached_fork_hash(char fork, uint32_t size, const std::function<std::string()> &calculate) const
+{
+    std::string hash;
+    if (!find_cached_hash(fork, size, hash)) {
+        hash = calculate();
+        add_cached_hash(fork, size, hash);
+    }
+    return hash;
+}
+
+std::string File::cache_location(char fork, uint32_t size) const
+{
+    // The disk path locates the partition in its image file
+    return std::format("{}|{}|{}|{}|{}", disk_->path(), id_, fork, size, hash_name(gContentHash));
+}
+
+bool File::find_cached_hash(char fork, uint32_t size, std::string &hash) const
+{
+    if (!gHashCache || !disk_ || disk_->fingerprint().empty()) {
+        return false;
+    }
+    return gHashCache->find(cache_location(fork, size), disk_->fingerprint(), hash);
+}
+
+void File::add_cached_hash(char fork, uint32_t size, const std::string &hash) const
+{
+    if (gHashCache && disk_ && !disk_->fingerprint().empty()) {
+        gHashCache->add(cache_location(fork, size), disk_->fingerprint(), hash);
+    }
+}
+
+uint64_t File::hash_data(hasher_t &hasher) const
+{
+    return data_fork_ ? data_fork_->hash(hasher) : 0;
+}
+
+uint64_t File::hash_rsrc(hasher_t &hasher) const
+{
+    return rsrc_fork_ ? rsrc_fork_->hash(hasher) : 0;
+}
+
+std::string File::calculate_rsrc_hash() const
 {
     auto rsrc = read_rsrc_all();
     if (rsrc.empty()) {
@@ -236,8 +338,8 @@ std::string File::calculate_rsrc_md5() const
     
     rsrc_parser_t parser(rsrc.size(), read_func);
     
-    // Extract clean resource data (handles invalid parser case internally)
-    std::string clean_rsrc = extract_clean_rsrc_data(parser, rsrc);
-    
-    return MD5(clean_rsrc).toStr();
+    // Hash clean resource data (handles invalid parser case internally)
+    auto hasher = make_hasher(gContentHash);
+    hash_clean_rsrc_data(parser, rsrc, *hasher);
+    return hasher->digest();
 }
@@ -1,10 +1,12 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <cstdint>
 #include <memory>
 #include <format>
+#include <functional>
 #include "fork.h"
 
 // Forward declarations
@@ -15,43 +17,71 @@ class fork_t;
 class File
 {
 	std::shared_ptr<Disk> disk_;
-	std::string name_;
-	std::string sane_name_;
-	std::string type_;
-	std::string creator_;
+	// The names are kept by the disk, sane_name_ is name_ unless sanitizing changes it
+	std::string_view name_;
+	std::string_view sane_name_;
+	uint32_t type_;    // Four characters codes, as read from the volume
+	uint32_t creator_;
+	uint32_t id_;
 	uint32_t data_size_;
 	uint32_t rsrc_size_;
 	Folder *parent_;
-	std::shared_ptr<Folder> retained_folder_;
-	std::unique_ptr<fork_t> data_fork_;
-	std::unique_ptr<fork_t> rsrc_fork_;
+	// Owned by the arena of the partition, like the File (see Folder)
+	fork_t *data_fork_;
+	fork_t *rsrc_fork_;
 
 public:
 	File(const std::shared_ptr<Disk> &disk,
-		 const std::string &name, const std::string &type,
-		 const std::string &creator, 
-		 std::unique_ptr<fork_t> data_fork,
-		 std::unique_ptr<fork_t> rsrc_fork);
+		 std::string_view name, uint32_t type,
+		 uint32_t creator, uint32_t id,
+		 fork_t *data_fork,
+		 fork_t *rsrc_fork);
 	~File();
+	File(const File &) = delete;
+	File &operator=(const File &) = delete;
 	const std::shared_ptr<Disk> &disk() const { return disk_; }
-	const std::string &name() const { return sane_name_; }
-	const std::string &type() const { return type_; }
-	const std::string &creator() const { return creator_; }
+	std::string_view name() const { return sane_name_; }
+	// The name as read from the volume, name() is its sanitized version
+	std::string_view original_name() const { return name_; }
+	// The codes as printed, with '.' for the characters that cannot be printed (see string_from_code)
+	std::string type() const;
+	std::string creator() const;
+	uint32_t type_code() const { return type_; }
+	uint32_t creator_code() const { return creator_; }
+	// Number of the file in its volume (HFS catalog node ID, MFS file number)
+	uint32_t id() const { return id_; }
 	uint32_t data_size() const { return data_size_; }
 	uint32_t rsrc_size() const { return rsrc_size_; }
 	Folder *parent() const { return parent_; }
 	void set_parent(Folder *parent) { parent_ = parent; }
-	std::vector<std::shared_ptr<Folder>> retained_path() const;
-	void retain_folder();
+	// Folders containing the file, from the root
+	std::vector<Folder *> path() const;
 	// concatenation of name, type, creator, datasize and rscsize
-	std::string key() const { return std::format( "{}|{}|{}|{}|{}", name_, type_, creator_, data_size_, rsrc_size_); }
+	std::string key() const { return std::format( "{}|{}|{}|{}|{}", name_, type(), creator(), data_size_, rsrc_size_); }
 	
-	// concatenation of name, type, creator, datasize, rscsize and content MD5 hashes
+	// concatenation of type, creator, datasize, rscsize and content hashes (see --hash)
 	std::string content_key() const;
 
+	// content_key() of several files; with MD5, their data forks are hashed together (see md5_multi_t)
+	static std::vector<std::string> content_keys(const std::vector<std::shared_ptr<File>> &files);
+
+	// Feed a fork to a hasher, a chunk at a time, returns the number of bytes hashed
+	uint64_t hash_data(hasher_t &hasher) const;
+	uint64_t hash_rsrc(hasher_t &hasher) const;
+
 private:
-	// Calculate MD5 hash of resource fork, skipping filesystem metadata padding
-	std::string calculate_rsrc_md5() const;
+	// Hash the resource fork in a canonical form, skipping filesystem metadata padding
+	std::string calculate_rsrc_hash() const;
+
+	// content_key(), with the hash of the data fork already computed
+	std::string content_key(const std::string &data_hash) const;
+
+	// Hash of a fork, from the hash cache if it has it (fork is 'D' or 'R')
+	std::string cached_fork_hash(char fork, uint32_t size, const std::function<std::string()> &calculate) const;
+	// Look up and record hashes in the hash cache, if there is one
+	std::string cache_location(char fork, uint32_t size) const;
+	bool find_cached_hash(char fork, uint32_t size, std::string &hash) const;
+	void add_cached_hash(char fork, uint32_t size, const std::string &hash) const;
 
 public:
 	// Read methods using fork_t
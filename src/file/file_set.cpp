@@ -17,7 +17,7 @@ void FileSet::add_file(std::shared_ptr<File> file)
 
     // Debug: Log the file path when adding to FileSet
 
-    std::string key = make_key(file->name(), file->type(), file->creator());
+    std::string key = make_key(std::string(file->name()), file->type(), file->creator());
 
     auto it = groups_.find(key);
     if (it != groups_.end())
@@ -28,12 +28,30 @@ void FileSet::add_file(std::shared_ptr<File> file)
     else
     {
         // Create new group
-        auto group = std::make_unique<FileGroup>(file->name(), file->type(), file->creator());
+        auto group = std::make_unique<FileGroup>(std::string(file->name()), file->type(), file->creator());
         group->files.push_back(file);
         groups_[key] = std::move(group);
     }
 }
 
+void FileSet::merge(FileSet &&other)
+{
+    for (auto &[key, group] : other.groups_)
+    {
+        auto it = groups_.find(key);
+        if (it != groups_.end())
+        {
+            auto &files = it->second->files;
+            files.insert(files.end(), group->files.begin(), group->files.end());
+        }
+        else
+        {
+            groups_[key] = std::move(group);
+        }
+    }
+    other.groups_.clear();
+}
+
 const std::map<std::string, std::unique_ptr<FileSet::FileGroup>> &FileSet::get_groups() const
 {
     return groups_;
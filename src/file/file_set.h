@@ -51,6 +51,12 @@ public:
      */
     void add_file(std::shared_ptr<File> file);
 
+    /**
+     * Move all files of another set into this one, after the files of the matching groups.
+     * Sets built from disjoint parts of a scan can be merged in scan order.
+     */
+    void merge(FileSet &&other);
+
     /**
      * Get all groups in the file set.
      */
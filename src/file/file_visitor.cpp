@@ -2,23 +2,24 @@
 #include "file/folder.h"
 #include "file/file.h"
 
+//  The shared pointers given to the visitor share the ownership of the folder (see Folder)
 void visit_folder(std::shared_ptr<Folder> folder, file_visitor_t &visitor)
 {
     if (visitor.pre_visit_folder(folder))
     {
-        for (const auto &file : folder->files())
+        for (auto file : folder->files())
         {
-            visitor.visit_file(file);
+            visitor.visit_file(std::shared_ptr<File>(folder, file));
         }
-        for (const auto &subfolder : folder->folders())
+        for (auto subfolder : folder->folders())
         {
-            visit_folder(subfolder, visitor);
+            visit_folder(std::shared_ptr<Folder>(folder, subfolder), visitor);
         }
         visitor.post_visit_folder(folder);
     }
 }
 
-std::string path_string(const std::vector<std::shared_ptr<Folder>> &path_vector)
+std::string path_string(const std::vector<Folder *> &path_vector)
 {
     if (path_vector.empty())
     {
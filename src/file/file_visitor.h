@@ -3,24 +3,50 @@
 #include <memory>
 #include <vector>
 #include <string>
+#include <string_view>
+#include <cstdint>
 
 // Forward declarations
 class Disk;
 class File;
 class Folder;
 
+// Metadata of a file, as read from the volume before the File is created
+// Nothing is converted, so that rejecting a file costs no allocation
+struct file_metadata_t
+{
+	std::string_view macroman_name; // As stored on the volume, File::name() is its sanitized UTF-8 version
+	uint32_t type;                   // Four characters codes, like File::type_code()
+	uint32_t creator;
+	uint32_t data_size;
+	uint32_t rsrc_size;
+};
+
 class file_visitor_t
 {
 public:
 	virtual ~file_visitor_t() = default;
 	virtual void pre_visit(std::shared_ptr<Disk>) {}
 	virtual void post_visit() {}
+	// Called when mounting, before the File is created; files that are not accepted are never created nor visited
+	// With --jobs, it is called concurrently from the threads mounting the partitions
+	virtual bool accepts_file(const file_metadata_t &) { return true; }
+	// False if accepts_file accepts every file, so partitions do not need to build the metadata
+	virtual bool has_file_filter() const { return false; }
 	virtual void visit_file(std::shared_ptr<File> file) = 0;
 	virtual bool pre_visit_folder(std::shared_ptr<Folder>) { return true; }
 	virtual void post_visit_folder(std::shared_ptr<Folder>) {}
+
+	// Concurrent traversal: fork() returns a visitor with the same configuration and an empty state,
+	// that is used by a single thread without locking, and merge() folds the state of a fork back
+	// Forks are merged in the order of a serial traversal, so the result does not depend on the scheduling
+	// fork() may be called concurrently; visitors that cannot be split (ie: printers) return nullptr
+	virtual std::shared_ptr<file_visitor_t> fork() const { return nullptr; }
+	// Only called with a visitor returned by fork() on this visitor
+	virtual void merge(file_visitor_t &) {}
 };
 
 void visit_folder(std::shared_ptr<Folder> folder, file_visitor_t &visitor);
 
 // Helper function to convert path vector to string
-std::string path_string(const std::vector<std::shared_ptr<Folder>> &path_vector);
\ No newline at end of file
+std::string path_string(const std::vector<Folder *> &path_vector);
\ No newline at end of file
@@ -1,5 +1,6 @@
 #include "file/folder.h"
 #include "file/file.h"
+#include "file/disk.h"
 #include "utils.h"
 
 #include <iostream>
@@ -11,8 +12,14 @@
 static int sFolderCount = 0;
 #endif
 
-Folder::Folder(const std::string &name) : name_(name), sane_name_(sanitize_string(name)), parent_(nullptr)
+Folder::Folder(Disk &disk, std::string_view name, std::pmr::memory_resource *resource)
+    : name_(disk.intern(name)), sane_name_(name_), files_(resource), folders_(resource), parent_(nullptr)
 {
+    auto sane_name = sanitize_string(std::string(name));
+    if (sane_name != name)
+    {
+        sane_name_ = disk.intern(sane_name);
+    }
 #ifdef DEBUG_MEMORY
     sFolderCount++;
 #endif
@@ -27,35 +34,33 @@ Folder::~Folder()
 #endif
 }
 
-void Folder::add_file(std::shared_ptr<File> file)
+void Folder::add_file(File *file)
 {
     // std::cout << "Adding file '" << file->name() << "' to folder '" << name_ << "'\n";
     if (file->parent() != nullptr)
     {
-        throw std::runtime_error("File '" + file->name() + "' is already in a folder");
+        throw std::runtime_error("File '" + std::string(file->name()) + "' is already in a folder");
     }
     file->set_parent(this);
     files_.push_back(file);
 }
 
-void Folder::add_folder(std::shared_ptr<Folder> folder)
+void Folder::add_folder(Folder *folder)
 {
     if (folder->parent() != nullptr)
     {
-        throw std::runtime_error("Folder '" + folder->name() + "' is already in a folder");
+        throw std::runtime_error("Folder '" + std::string(folder->name()) + "' is already in a folder");
     }
     folder->set_parent(this);
     folders_.push_back(folder);
 }
 
-std::vector<std::shared_ptr<Folder>> Folder::path()
+std::vector<Folder *> Folder::path() const
 {
-    std::vector<std::shared_ptr<Folder>> result;
-    Folder *current = this;
-    while (current->parent_)
+    std::vector<Folder *> result;
+    for (Folder *current = parent_; current; current = current->parent_)
     {
-        result.push_back(current->parent_->shared_from_this());
-        current = current->parent_;
+        result.push_back(current);
     }
     std::reverse(result.begin(), result.end());
     return result;
@@ -1,50 +1,40 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <vector>
-#include <memory>
+#include <memory_resource>
 
 // Forward declarations
+class Disk;
 class File;
 
-class Folder : public std::enable_shared_from_this<Folder>
+// Folders, files and forks of a partition live in the object arena of the partition (see object_arena_t),
+// and refer to each other with plain pointers: a shared pointer to any of them keeps all of them
+class Folder
 {
-	std::string name_;
-	std::string sane_name_;
-	std::vector<std::shared_ptr<File>> files_;
-	std::vector<std::shared_ptr<Folder>> folders_;
+	// The names are kept by the disk, sane_name_ is name_ unless sanitizing changes it
+	std::string_view name_;
+	std::string_view sane_name_;
+	std::pmr::vector<File *> files_;
+	std::pmr::vector<Folder *> folders_;
 	Folder *parent_;
-	std::shared_ptr<Folder> retained_folder_;
 
 public:
-	Folder(const std::string &name);
+	// The vectors of children are allocated from resource, usually the arena of the folder
+	Folder(Disk &disk, std::string_view name, std::pmr::memory_resource *resource);
 	~Folder();
-	void add_file(std::shared_ptr<File> file);
-	void add_folder(std::shared_ptr<Folder> folder);
+	Folder(const Folder &) = delete;
+	Folder &operator=(const Folder &) = delete;
+	void add_file(File *file);
+	void add_folder(Folder *folder);
 
-	const std::string &name() const { return sane_name_; }
-	const std::vector<std::shared_ptr<File>> &files() const { return files_; }
-	const std::vector<std::shared_ptr<Folder>> &folders() const { return folders_; }
+	std::string_view name() const { return sane_name_; }
+	const std::pmr::vector<File *> &files() const { return files_; }
+	const std::pmr::vector<Folder *> &folders() const { return folders_; }
 	Folder *parent() const { return parent_; }
 	void set_parent(Folder *parent) { parent_ = parent; }
-	std::shared_ptr<Folder> retained_folder() const { return retained_folder_; }
-	void retain_folder()
-	{
-		if (parent_)
-		{
-			retained_folder_ = parent_->shared_from_this();
-			retained_folder_->retain_folder();
-		}
-	}
-	void release()
-	{
-		files_.clear();
-		for (auto &folder : folders_)
-		{
-			folder->release();
-		}
-		folders_.clear();
-	}
 
-	std::vector<std::shared_ptr<Folder>> path();
-};
\ No newline at end of file
+	// Enclosing folders, from the root
+	std::vector<Folder *> path() const;
+};
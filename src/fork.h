@@ -2,6 +2,8 @@
 
 #include <vector>
 #include <cstdint>
+#include <algorithm>
+#include "utils/hasher.h"
 
 /**
  * Abstract interface for file fork access (data and resource forks).
@@ -9,6 +11,9 @@
  */
 class fork_t {
 public:
+    // Bytes read at once when a fork is hashed
+    static const uint32_t hash_chunk_size = 64 * 1024;
+
     virtual ~fork_t() = default;
 
     /**
@@ -24,4 +29,26 @@ public:
      * @return Vector containing the requested data (may be shorter than requested size)
      */
     virtual std::vector<uint8_t> read(uint32_t offset, uint32_t size) = 0;
+
+    /**
+     * Feed the content of this fork to a hasher, a chunk at a time,
+     * so the whole fork is never in memory.
+     * @param hasher The hasher
+     * @return Number of bytes hashed (less than the size if the fork ends early)
+     */
+    uint64_t hash(hasher_t &hasher)
+    {
+        uint32_t offset = 0;
+        while (offset < size())
+        {
+            auto chunk = read(offset, std::min(hash_chunk_size, size() - offset));
+            if (chunk.empty())
+            {
+                break;
+            }
+            hasher.update(chunk.data(), chunk.size());
+            offset += static_cast<uint32_t>(chunk.size());
+        }
+        return offset;
+    }
 };
\ No newline at end of file
@@ -7,12 +7,12 @@ class type_node_t
 {
 protected:
 	block_t &block_;
-	T *content;
+	const T *content;
 
 public:
 	type_node_t(block_t &block) : block_(block)
 	{
-		content = reinterpret_cast<T *>(block_.data());
+		content = reinterpret_cast<const T *>(block_.data());
 	}
 
 	// T *operator->() { return content; }
@@ -74,6 +74,8 @@ public:
 
 	bool isHFSVolume() const;
 	std::string getVolumeName() const;
+	uint32_t fileCount() const { return be32(content->drFilCnt); }
+	uint32_t folderCount() const { return be32(content->drDirCnt); }
 	uint32_t allocationBlockSize() const;
 	uint16_t allocationBlockStart() const;
 	uint16_t extendsExtendStart(int index) const;
@@ -84,7 +86,7 @@ public:
 
 class btree_header_node_t : public type_node_t<BTNodeDescriptor>
 {
-	BTHeaderRec *header_record_;
+	const BTHeaderRec *header_record_;
 
 public:
 	btree_header_node_t(block_t &block) : type_node_t<BTNodeDescriptor>(block)
@@ -96,12 +98,14 @@ public:
 		{
 			throw std::runtime_error("Not a valid B-tree header node");
 		}
-		header_record_ = reinterpret_cast<BTHeaderRec *>((char *)block.data() + sizeof(BTNodeDescriptor));
+		header_record_ = reinterpret_cast<const BTHeaderRec *>((const char *)block.data() + sizeof(BTNodeDescriptor));
 	}
 
 	uint32_t first_leaf_node() const { return be32(header_record_->firstLeafNode); }
 	uint16_t node_size() const { return be16(header_record_->nodeSize); }
 	uint32_t node_count() const { return be32(header_record_->totalNodes); }
+	uint32_t root_node() const { return be32(header_record_->rootNode); }
+	uint16_t tree_depth() const { return be16(header_record_->treeDepth); }
 };
 
 class btree_leaf_node_t : public type_node_t<BTNodeDescriptor>
@@ -113,13 +117,25 @@ public:
 
 	uint32_t f_link() const { return be32(content->fLink); }
 
-	std::pair<void *, uint16_t> get_record(uint16_t record_index) const
+	int8_t kind() const { return content->kind; }
+
+	uint8_t height() const { return content->height; }
+
+	//	True if the descriptor looks like a leaf node whose offset table fits in the node
+	bool is_valid_leaf() const
+	{
+		uint16_t num = num_records();
+		return kind() == ndLeafNode && height() == 1 && num > 0 &&
+			   sizeof(BTNodeDescriptor) + 2 * (num + 1) <= 512;
+	}
+
+	std::pair<const void *, uint16_t> get_record(uint16_t record_index) const
 	{
 		uint16_t num = num_records();
 
 		// Calculate offset table position (at end of node)
-		uint16_t *offset_table = reinterpret_cast<uint16_t *>(
-			reinterpret_cast<uint8_t *>(content) + 512 - 2 * (num + 1));
+		const uint16_t *offset_table = reinterpret_cast<const uint16_t *>(
+			reinterpret_cast<const uint8_t *>(content) + 512 - 2 * (num + 1));
 
 #ifdef VERBOSE
 		// Debug: Print addresses
@@ -138,13 +154,110 @@ public:
 		std::cout << std::format("Record start = {} end = {}\n", record_start, record_end);
 #endif
 
-		uint8_t *record_ptr = reinterpret_cast<uint8_t *>(content) + record_start;
+		const uint8_t *record_ptr = reinterpret_cast<const uint8_t *>(content) + record_start;
 		uint16_t record_size = record_end - record_start;
 
 		return std::make_pair(record_ptr, record_size);
 	}
+
+	//	get_record counts from the end of the offset table, this counts in key order
+	std::pair<const void *, uint16_t> get_sorted_record(uint16_t record_index) const
+	{
+		return get_record(num_records() - 1 - record_index);
+	}
 };
 
+//	Records start with a key, prefixed by its length
+//	The data that follows is word aligned (68k requirement)
+static const uint8_t *record_data(const void *record)
+{
+	const uint8_t *raw = static_cast<const uint8_t *>(record);
+	uint16_t offset = 1 + raw[0];
+	if (offset & 1)
+	{
+		offset++;
+	}
+	return raw + offset;
+}
+
+//	The HFS catalog orders names with the Mac OS RelString rules:
+//	case-insensitive, diacritic-sensitive, accented letters sorted right after their base letter
+//	This gives the rank of each MacRoman character in that order
+static const uint8_t hfs_name_order[256] = {
+	// 0x00-0x1F: control characters
+	0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F,
+	0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1A, 0x1B, 0x1C, 0x1D, 0x1E, 0x1F,
+	// 0x20-0x3F: punctuation and digits, leaving room for the typographic quotes
+	0x20, 0x22, 0x23, 0x28, 0x29, 0x2A, 0x2B, 0x2C, 0x2F, 0x30, 0x31, 0x32, 0x33, 0x34, 0x35, 0x36,
+	0x37, 0x38, 0x39, 0x3A, 0x3B, 0x3C, 0x3D, 0x3E, 0x3F, 0x40, 0x41, 0x42, 0x43, 0x44, 0x45, 0x46,
+	// 0x40-0x7F: letters, with room for the accented variants, lower case sorts as upper case
+	0x47, 0x48, 0x57, 0x59, 0x5D, 0x5F, 0x66, 0x68, 0x6A, 0x6C, 0x72, 0x74, 0x76, 0x78, 0x7A, 0x7E,
+	0x8C, 0x8E, 0x90, 0x92, 0x95, 0x97, 0x9E, 0xA0, 0xA2, 0xA4, 0xA7, 0xA9, 0xAA, 0xAB, 0xAC, 0xAD,
+	0x4E, 0x48, 0x57, 0x59, 0x5D, 0x5F, 0x66, 0x68, 0x6A, 0x6C, 0x72, 0x74, 0x76, 0x78, 0x7A, 0x7E,
+	0x8C, 0x8E, 0x90, 0x92, 0x95, 0x97, 0x9E, 0xA0, 0xA2, 0xA4, 0xA7, 0xAF, 0xB0, 0xB1, 0xB2, 0xB3,
+	// 0x80-0x9F: accented letters
+	0x4A, 0x4C, 0x5A, 0x60, 0x7B, 0x7F, 0x98, 0x4F, 0x49, 0x51, 0x4A, 0x4B, 0x4C, 0x5A, 0x60, 0x63,
+	0x64, 0x65, 0x6E, 0x6F, 0x70, 0x71, 0x7B, 0x84, 0x85, 0x86, 0x7F, 0x80, 0x9A, 0x9B, 0x9C, 0x98,
+	// 0xA0-0xDF: symbols, ligatures and the remaining accented letters
+	0xB4, 0xB5, 0xB6, 0xB7, 0xB8, 0xB9, 0xBA, 0x94, 0xBB, 0xBC, 0xBD, 0xBE, 0xBF, 0xC0, 0x4D, 0x81,
+	0xC1, 0xC2, 0xC3, 0xC4, 0xC5, 0xC6, 0xC7, 0xC8, 0xC9, 0xCA, 0xCB, 0x55, 0x8A, 0xCC, 0x4D, 0x81,
+	0xCD, 0xCE, 0xCF, 0xD0, 0xD1, 0xD2, 0xD3, 0x26, 0x27, 0xD4, 0x20, 0x49, 0x4B, 0x80, 0x82, 0x82,
+	0xD5, 0xD6, 0x24, 0x25, 0x2D, 0x2E, 0xD7, 0xD8, 0xA6, 0xD9, 0xDA, 0xDB, 0xDC, 0xDD, 0xDE, 0xDF,
+	// 0xE0-0xFF: not part of the original character set, sorted by code
+	0xE0, 0xE1, 0xE2, 0xE3, 0xE4, 0xE5, 0xE6, 0xE7, 0xE8, 0xE9, 0xEA, 0xEB, 0xEC, 0xED, 0xEE, 0xEF,
+	0xF0, 0xF1, 0xF2, 0xF3, 0xF4, 0xF5, 0xF6, 0xF7, 0xF8, 0xF9, 0xFA, 0xFB, 0xFC, 0xFD, 0xFE, 0xFF};
+
+//	Compares two MacRoman names in catalog order
+static int compare_names(const uint8_t *name1, size_t length1, const uint8_t *name2, size_t length2)
+{
+	size_t length = std::min(length1, length2);
+	for (size_t i = 0; i != length; i++)
+	{
+		int difference = hfs_name_order[name1[i]] - hfs_name_order[name2[i]];
+		if (difference)
+		{
+			return difference;
+		}
+	}
+	return static_cast<int>(length1) - static_cast<int>(length2);
+}
+
+//	Compares a catalog key (from a leaf or an index record) with (parent_id, name)
+//	Keys are ordered by parent ID, then by name
+static int compare_catalog_key(const void *record, uint32_t parent_id, const std::string &name)
+{
+	const HFSCatalogKey *key = static_cast<const HFSCatalogKey *>(record);
+	uint32_t key_parent_id = be32(key->parentID);
+	if (key_parent_id != parent_id)
+	{
+		return key_parent_id < parent_id ? -1 : 1;
+	}
+	size_t key_length = std::min<size_t>(key->nodeName[0], sizeof(key->nodeName) - 1);
+	return compare_names(key->nodeName + 1, key_length,
+						 reinterpret_cast<const uint8_t *>(name.data()), name.size());
+}
+
+//	Compares an extents key with (file_id, fork_type, start_block)
+static int compare_extents_key(const void *record, uint32_t file_id, uint8_t fork_type, uint16_t start_block)
+{
+	const HFSExtentsRecord *key = static_cast<const HFSExtentsRecord *>(record);
+	uint32_t key_file_id = be32(key->fileID);
+	if (key_file_id != file_id)
+	{
+		return key_file_id < file_id ? -1 : 1;
+	}
+	if (key->forkType != fork_type)
+	{
+		return key->forkType < fork_type ? -1 : 1;
+	}
+	uint16_t key_start_block = be16(key->startBlock);
+	if (key_start_block != start_block)
+	{
+		return key_start_block < start_block ? -1 : 1;
+	}
+	return 0;
+}
+
 class extents_record_t
 {
 public:
@@ -201,14 +314,8 @@ public:
 
 	const uint8_t *data() const
 	{
-		const uint8_t *raw = reinterpret_cast<const uint8_t *>(key_);
-		uint16_t offset = 1 + key_length(); // keyLength field (1 byte) + key content (reserved + parentID + nodeName)
-		// 68k requires word alignment - round up to next even address if odd
-		if (offset & 1)
-		{
-			offset++;
-		}
-		return raw + offset;
+		// keyLength field (1 byte) + key content (reserved + parentID + nodeName), word aligned
+		return record_data(key_);
 	}
 
 	uint16_t type() const
@@ -220,6 +327,8 @@ public:
 
 	uint32_t parent_id() const { return be32(key_->parentID); }
 	std::string name() const { return string_from_pstring(key_->nodeName); }
+	// The name as stored, in MacRoman, without a copy
+	std::string_view macroman_name() const { return {reinterpret_cast<const char *>(key_->nodeName + 1), key_->nodeName[0]}; }
 };
 
 class catalog_record_folder_t
@@ -245,6 +354,8 @@ public:
 	uint32_t file_id() const { return be32(file_->fileID); }
 	std::string type() const { return string_from_code(be32(file_->userInfo.fdType)); }
 	std::string creator() const { return string_from_code(be32(file_->userInfo.fdCreator)); }
+	uint32_t type_code() const { return be32(file_->userInfo.fdType); }
+	uint32_t creator_code() const { return be32(file_->userInfo.fdCreator); }
 	uint32_t fileID() const { return be32(file_->fileID); }
 	int32_t dataLogicalSize() const { return be32(file_->dataLogicalSize); }
 	int32_t dataPhysicalSize() const { return be32(file_->dataPhysicalSize); }
@@ -256,50 +367,246 @@ public:
 	const HFSExtentRecord* rsrcExtents() const { return file_->rsrcExtents; }
 };
 
+class catalog_record_thread_t
+{
+	const HFSCatalogThread *thread_;
+
+public:
+	catalog_record_thread_t(const HFSCatalogThread *thread)
+		: thread_(thread) {}
+
+	uint32_t parent_id() const { return be32(thread_->parentID); }
+	std::string name() const { return string_from_pstring(thread_->nodeName); }
+};
+
 class btree_file_t
 {
+public:
+	//	How iterate_leaves finds the leaf nodes
+	enum class traversal_t
+	{
+		leaf_chain,		  //	Follow the fLink of each leaf node, one read per node
+		physical,		  //	Read the whole file sequentially, leaves in on-disk order
+		physical_ordered, //	Read the whole file sequentially, leaves in key order
+	};
+
+private:
 	hfs_file_t &file_;
 
 	uint32_t first_leaf_node_; //	first leaf node position relative to file
 	uint16_t node_size_;	   //	node size in bytes
+	uint32_t node_count_;	   //	total number of nodes in the file
+	uint32_t root_node_;	   //	root node position relative to file, 0 if the tree is empty
+	uint16_t tree_depth_;	   //	number of levels, including the leaves
+	traversal_t traversal_ = traversal_t::leaf_chain;
+
+	//	Reads a single node of the file
+	block_t read_node(uint32_t node_index);
+
+	//	Reads all the nodes of the file, in large sequential chunks
+	std::vector<block_t> read_all_nodes();
+
+	//	Marks the nodes that are in use, according to the map records
+	//	of the header node and of the map nodes chained to it
+	std::vector<bool> used_nodes(std::vector<block_t> &nodes) const;
+
+	//	Reorders leaf node indexes in key order, by following the leaf chain in memory
+	//	Leaves that are not reachable from the chain are kept, in physical order, at the end
+	std::vector<uint32_t> chain_order(std::vector<block_t> &nodes, const std::vector<uint32_t> &leaves) const;
 
 public:
 	btree_file_t(hfs_file_t &file);
 
+	void set_traversal(traversal_t traversal) { traversal_ = traversal; }
+
+	//	Reads the whole file, classifies each node using its descriptor,
+	//	and calls the callback for each leaf node in physical order
+	//	or in key order if ordered is set
+	//	Unlike the leaf chain, this finds all the leaves of a tree whose chain is broken
+	template <typename F>
+	void scan_leaves(F &&callback, bool ordered)
+	{
+		auto nodes = read_all_nodes();
+		auto used = used_nodes(nodes);
+
+		std::vector<uint32_t> leaves;
+		for (uint32_t i = 0; i != nodes.size(); i++)
+		{
+			if (used[i] && btree_leaf_node_t(nodes[i]).is_valid_leaf())
+			{
+				leaves.push_back(i);
+			}
+		}
+
+		if (ordered)
+		{
+			leaves = chain_order(nodes, leaves);
+		}
+
+		for (auto index : leaves)
+		{
+			btree_leaf_node_t leaf(nodes[index]);
+			callback(leaf);
+		}
+	}
+
 	//	This will iterate all the leaf nodes in the btree
 	//	and call the callback for each one
 	//	with a btree_leaf_node_t& as parameter
-	//	To perform the iteration, it uses the fLink field
+	//	With the leaf_chain traversal, it uses the fLink field
 	//	of each leaf node to find the next one
 	template <typename F>
 	void iterate_leaves(F &&callback)
 	{
+		if (traversal_ != traversal_t::leaf_chain)
+		{
+			scan_leaves(callback, traversal_ == traversal_t::physical_ordered);
+			return;
+		}
+
 		auto block_index = first_leaf_node_;
 
 		while (block_index)
 		{
-			uint32_t file_offset = block_index * node_size_;
-			uint64_t allocation_offset = file_.allocation_offset(file_offset);
-#ifdef VERBOSE
-			std::cout << std::format("**** {} IS THE BTREE BLOC #\n", block_index);
-			std::cout << std::format("**** {} IS THE LOCAL OFFSET\n", file_offset);
-			std::cout << std::format("**** {} IS THE ALLOC OFFSET\n", allocation_offset);
-#endif
-			//	We find the "allocation" block corresponding to this btree block
-
-// convert to allocation block
-// uint32_t allocation_index = file.
-// auto local_index = file_.to_absolute_block(block_index);
-#ifdef VERBOSE
-			std::cout << std::format("iterate_leaves() - first leaf node: {}, allocation offset:{} node size: {}\n", first_leaf_node_, allocation_offset, node_size_);
-#endif
-			block_t block = file_.partition().read_allocation(allocation_offset, node_size_);
+			block_t block = read_node(block_index);
 			btree_leaf_node_t leaf(block);
 			callback(leaf);
 			block_index = leaf.f_link();
 		}
 	}
 
+	//	Descends the index nodes from the root to find the leaf record matching a key
+	//	compare is called with a pointer to a record key and returns <0, 0 or >0
+	//	if that key is before, equal or after the searched key
+	//	The callback gets a pointer to the found record and its size
+	//	Returns false if there is no record with that key
+	template <typename C, typename F>
+	bool find_record(C &&compare, F &&callback)
+	{
+		uint32_t node_index = root_node_;
+
+		for (uint16_t level = 0; node_index != 0 && level != tree_depth_; level++)
+		{
+			block_t block = read_node(node_index);
+			btree_leaf_node_t node(block);
+			uint16_t num_records = node.num_records();
+
+			if (node.kind() == ndLeafNode)
+			{
+				for (uint16_t i = 0; i != num_records; i++)
+				{
+					auto [ptr, size] = node.get_sorted_record(i);
+					int order = compare(ptr);
+					if (order == 0)
+					{
+						callback(ptr, size);
+						return true;
+					}
+					if (order > 0)
+					{
+						break;
+					}
+				}
+				return false;
+			}
+
+			if (node.kind() != ndIndxNode)
+			{
+				throw std::runtime_error(std::format("Unexpected node kind {} in b-tree index", static_cast<int>(node.kind())));
+			}
+
+			//	Each index record holds the first key of a child node,
+			//	so the searched key is in the last child whose key is not after it
+			uint32_t child_index = 0;
+			for (uint16_t i = 0; i != num_records; i++)
+			{
+				auto [ptr, size] = node.get_sorted_record(i);
+				if (compare(ptr) > 0)
+				{
+					break;
+				}
+				child_index = be32(record_data(ptr));
+			}
+			node_index = child_index;
+		}
+
+		return false;
+	}
+
+	//	Finds the catalog record of a folder or file from its parent ID and its MacRoman name
+	//	Callback gets the same parameters as the iterate_catalog one
+	template <typename F>
+	bool find_catalog(uint32_t parent_id, const std::string &name, F &&callback)
+	{
+		bool found = false;
+		find_record([&](const void *key)
+					{ return compare_catalog_key(key, parent_id, name); },
+					[&](const void *ptr, uint16_t)
+					{ found = dispatch_catalog_record(ptr, callback); });
+		return found;
+	}
+
+	//	Finds the thread record of a folder (or file) from its CNID
+	//	Callback gets a catalog_record_thread_t *
+	template <typename F>
+	bool find_thread(uint32_t cnid, F &&callback)
+	{
+		bool found = false;
+		find_record([&](const void *key)
+					{ return compare_catalog_key(key, cnid, ""); },
+					[&](const void *ptr, uint16_t)
+					{
+						catalog_record_t catalog_record{static_cast<const HFSCatalogKey *>(ptr)};
+						if (catalog_record.type() == kHFSFolderThreadRecord || catalog_record.type() == kHFSFileThreadRecord)
+						{
+							catalog_record_thread_t thread_record{reinterpret_cast<const HFSCatalogThread *>(catalog_record.data())};
+							callback(&thread_record);
+							found = true;
+						} });
+		return found;
+	}
+
+	//	Finds the extents record of a fork starting at a given file-relative allocation block
+	//	Callback gets an extents_record_t
+	template <typename F>
+	bool find_extents(uint32_t file_id, uint8_t fork_type, uint16_t start_block, F &&callback)
+	{
+		return find_record([&](const void *key)
+						   { return compare_extents_key(key, file_id, fork_type, start_block); },
+						   [&](const void *ptr, uint16_t)
+						   { callback(extents_record_t{static_cast<const HFSExtentsRecord *>(ptr)}); });
+	}
+
+	//	Calls the callback with the folder or file record at ptr
+	//	Returns false for other records (threads)
+	template <typename F>
+	static bool dispatch_catalog_record(const void *ptr, F &&callback)
+	{
+		const HFSCatalogKey *key = reinterpret_cast<const HFSCatalogKey *>(ptr);
+		catalog_record_t catalog_record{key};
+
+		if (catalog_record.type() == kHFSFolderRecord) // folder
+		{
+			const HFSCatalogFolder *folder = reinterpret_cast<const HFSCatalogFolder *>(catalog_record.data());
+			catalog_record_folder_t folder_record{folder};
+			callback(&catalog_record, &folder_record, nullptr);
+			return true;
+		}
+		else if (catalog_record.type() == kHFSFileRecord) // file
+		{
+			const HFSCatalogFile *file = reinterpret_cast<const HFSCatalogFile *>(catalog_record.data());
+			catalog_record_file_t file_record{file};
+			callback(&catalog_record, nullptr, &file_record);
+			return true;
+		}
+#ifdef VERBOSE
+		else
+			std::cout << std::format("  {} [{}]\n", catalog_record.type(), catalog_record.name());
+#endif
+		// others (thread, etc...) are ignored
+		return false;
+	}
+
 	//	This iterates all records in the btree
 	//	Using the iterate_leaves function
 	//	In each leaf, it iterates all records
@@ -339,30 +646,7 @@ public:
 	void iterate_catalog(F &&callback)
 	{
 		iterate_records([&](const void *ptr, uint16_t)
-						{
-							const HFSCatalogKey *key = reinterpret_cast<const HFSCatalogKey *>(ptr);
-							catalog_record_t catalog_record{key};
-
-							if (catalog_record.type() == kHFSFolderRecord) // folder
-							{
-								const HFSCatalogFolder *folder = reinterpret_cast<const HFSCatalogFolder *>(catalog_record.data());
-								catalog_record_folder_t folder_record{folder};
-								callback(&catalog_record, &folder_record, nullptr);
-								return;
-							}
-							else if (catalog_record.type() == kHFSFileRecord) // file
-							{
-								const HFSCatalogFile *file = reinterpret_cast<const HFSCatalogFile *>(catalog_record.data());
-								catalog_record_file_t file_record{file};
-								callback(&catalog_record, nullptr, &file_record);
-								return;
-							}
-#ifdef VERBOSE
-							else
-								std::cout << std::format("  {} [{}]\n", catalog_record.type(), catalog_record.name());
-#endif
-							// others (thread, etc...) are ignored
-						});
+						{ dispatch_catalog_record(ptr, callback); });
 	}
 };
 
@@ -469,57 +753,55 @@ uint16_t master_directory_block_t::catalogExtendCount(int index) const
 void hfs_file_t::add_extent(const hfs_file_t::extent_t &extend)
 {
     extents_.push_back(extend);
+    extent_first_block_.push_back(block_count_);
+    block_count_ += extend.count;
 }
 
 void hfs_file_t::add_extent(uint16_t start_block, const hfs_file_t::extent_t &extent)
 {
     //  check that we already have start_block blocks in the extent
-    uint16_t total_blocks = 0;
-    for (const auto &ext : extents_)
-    {
-        total_blocks += ext.count;
-    }
-    if (total_blocks != start_block)
+    if (block_count_ != start_block)
     {
         throw std::runtime_error("Extent continuity error: expected " +
                                  std::to_string(start_block) + " blocks, but have " +
-                                 std::to_string(total_blocks));
+                                 std::to_string(block_count_));
     }
 
-    extents_.push_back(extent);
+    add_extent(extent);
 }
 
-uint16_t hfs_file_t::to_absolute_block(uint16_t block) const
+size_t hfs_file_t::extent_index(uint32_t block) const
 {
-    uint16_t absolute_block = 0;
-    for (const auto &extent : extents_)
+    if (block >= block_count_)
     {
-        if (block < extent.count)
-        {
-            return absolute_block + extent.start + block;
-        }
-        block -= extent.count;
-        absolute_block += extent.count;
+        throw std::out_of_range("Block out of range");
     }
-    throw std::out_of_range("Block out of range");
+
+    //  Last extent starting at or before block
+    auto it = std::upper_bound(extent_first_block_.begin(), extent_first_block_.end(), block);
+    return static_cast<size_t>(it - extent_first_block_.begin()) - 1;
+}
+
+uint16_t hfs_file_t::to_absolute_block(uint16_t block) const
+{
+    size_t index = extent_index(block);
+    return extents_[index].start + (block - extent_first_block_[index]);
 }
 
 uint64_t hfs_file_t::allocation_offset(uint32_t offset) const
 {
     auto allocation_block_size = static_cast<uint64_t>(partition_.allocation_block_size());
-    
-    for (auto &ext : extents_)
-    {
-        uint64_t extent_size = static_cast<uint64_t>(ext.count) * allocation_block_size;
-        if (offset < extent_size)
-        {
-            uint64_t result = static_cast<uint64_t>(ext.start) * allocation_block_size + offset;
-            return result;
-        }
-        offset -= extent_size;
-    }
-    
-    throw std::out_of_range("Offset out of range");
+
+    uint32_t block = static_cast<uint32_t>(offset / allocation_block_size);
+    size_t index = extent_index(block);
+    uint64_t allocation_block = extents_[index].start + (block - extent_first_block_[index]);
+
+    return allocation_block * allocation_block_size + offset % allocation_block_size;
+}
+
+uint64_t hfs_file_t::physical_size() const
+{
+    return static_cast<uint64_t>(block_count_) * partition_.allocation_block_size();
 }
 
 btree_file_t hfs_file_t::as_btree_file()
@@ -539,45 +821,14 @@ std::vector<uint8_t> hfs_file_t::read(uint32_t offset, uint32_t size) const
     // 2. The hfs_file_t logical_size_ may not be set for resource forks during construction
     // 3. The caller (hfs_fork_t) knows the correct logical size and has validated the request
     
-    std::vector<uint8_t> result;
-    result.reserve(size);
-    
-    uint32_t bytes_read = 0;
-    auto allocation_block_size = partition_.allocation_block_size();
+    std::vector<uint8_t> result(size);
+    uint8_t *destination = result.data();
     
-    // Read data block by block to avoid crossing extent boundaries
-    while (bytes_read < size) {
-        uint32_t current_offset = offset + bytes_read;
-        uint32_t remaining = size - bytes_read;
-        
-        // Calculate offset within current allocation block
-        uint32_t block_offset = current_offset % allocation_block_size;
-        uint32_t bytes_left_in_block = allocation_block_size - block_offset;
-        uint32_t bytes_to_read = std::min(remaining, bytes_left_in_block);
-        
-        // Get the absolute disk offset for this file offset
-        uint64_t alloc_offset = allocation_offset(current_offset);
-        
-        // Read from the allocation
-        block_t block_data = partition_.read_allocation(alloc_offset, bytes_to_read);
-        
-        // Verify we got the expected amount of data
-        if (block_data.size() < bytes_to_read) {
-            // This shouldn't happen unless we hit end of partition
-            bytes_to_read = block_data.size();
-        }
-        
-        // Copy the data from the block
-        const uint8_t* block_ptr = static_cast<const uint8_t*>(block_data.data());
-        result.insert(result.end(), block_ptr, block_ptr + bytes_to_read);
-        
-        bytes_read += bytes_to_read;
-        
-        // Safety check to avoid infinite loops
-        if (bytes_to_read == 0) {
-            break;
-        }
-    }
+    // One read per contiguous run, only splitting at extent boundaries
+    iterate_runs(offset, size, [&](uint64_t allocation_offset, uint32_t length) {
+        partition_.read_allocation_into(allocation_offset, length, destination);
+        destination += length;
+    });
     
     return result;
 }
@@ -613,6 +864,12 @@ block_t hfs_partition_t::read_allocated_block(uint16_t block, uint16_t size)
 #define CNID_ROOT 2
 #define CNID_CATALOG 4
 
+//  Size of the sequential reads when scanning a whole b-tree file, read around the page cache
+static const uint64_t SCAN_CHUNK_SIZE = 1024 * 1024;
+
+//  The MDB counts are only used as allocation hints, a damaged MDB should not make us reserve gigabytes
+static const uint32_t MAX_RESERVED_ENTRIES = 1 << 20;
+
 //  This is more than "building root", it is "mounting the partition and creating proxy for all the files"
 void hfs_partition_t::initialize_partition()
 {
@@ -628,6 +885,9 @@ void hfs_partition_t::initialize_partition()
 
     allocationBlockSize_ = mdb.allocationBlockSize();
     allocationStart_ = mdb.allocationBlockStart();
+    volume_name_ = from_macroman(mdb.getVolumeName());
+    file_count_ = mdb.fileCount();
+    folder_count_ = mdb.folderCount();
 
 #ifdef VERBOSE
     std::cout << std::format("Allocation block size: {}\n", allocationBlockSize_);
@@ -665,12 +925,12 @@ void hfs_partition_t::initialize_partition()
     }
 }
 
-void hfs_partition_t::build_root_folder()
+std::shared_ptr<Folder> hfs_partition_t::build_root_folder(file_visitor_t *visitor)
 {
-    // Read MDB again to get volume name for Disk object
-    block_t mdb_block = read(2);
-    master_directory_block_t mdb = as_master_directory_block(mdb_block);
-    auto disk = std::make_shared<Disk>(from_macroman(mdb.getVolumeName()), datasource_->description());
+    auto disk = std::make_shared<Disk>(volume_name_, datasource_->description(), datasource_->fingerprint());
+
+    //  The folders, files and forks are all allocated from one arena, released with the last of them
+    auto arena = std::make_shared<object_arena_t>();
 
     //  However, the MDB only gives us the first 3 extents for each file
     //  It is always enough for extends [citation needed]
@@ -679,63 +939,97 @@ void hfs_partition_t::build_root_folder()
     // Get additional extents from the extents B-tree
     btree_file_t extents_btree = extents_.as_btree_file();
     
-    // First, build complete extent information for ALL files
+    // B-trees are read sequentially, unless asked to follow the leaf chain
+    auto traversal = gLeafChain ? btree_file_t::traversal_t::leaf_chain : btree_file_t::traversal_t::physical_ordered;
+    extents_btree.set_traversal(traversal);
+
+    // Overflow extents of all files, in file order: (fileID, forkType) -> extents
+    // They go after the 3 extents found in the catalog record of the file
+    std::map<std::pair<uint32_t, uint8_t>, std::vector<hfs_file_t::extent_t>> overflow_extents;
+
     extents_btree.iterate_extents([&](const extents_record_t &extent_record)
                                   {
         uint8_t forkType = extent_record.fork_type();
         uint32_t file_ID = extent_record.file_ID();
         
-        // Create key for this file/fork combination
-        auto key = std::make_pair(file_ID, forkType);
-        
-        // Create or get existing hfs_file_t for this file/fork
-        auto it = files_.find(key);
-        if (it == files_.end()) {
-            // Create new hfs_file_t in the map
-            it = files_.emplace(key, hfs_file_t(*this)).first;
-        }
+        auto &extents = overflow_extents[std::make_pair(file_ID, forkType)];
 
-        // Add all extents from this record to the hfs_file_t
         for (int i = 0; i < 3; i++) {
             auto extent = extent_record.get_extent(i);
             if (extent.count > 0) {
-                it->second.add_extent(extent);
+                extents.push_back(extent);
 #ifdef VERBOSE
                 std::cout << std::format("Added extent for file {} fork {}: start={}, count={}\n", 
                                         file_ID, forkType, extent.start, extent.count);
 #endif
             }
+        } });
+
+    //  Creates the fork of a file from the extents of its catalog record and the overflow extents
+    auto make_fork = [&](uint32_t fileID, uint8_t forkType, uint32_t logical_size, const HFSExtentRecord *catalog_extents) -> fork_t *
+    {
+        auto key = std::make_pair(fileID, forkType);
+        auto [it, inserted] = files_.emplace(key, hfs_file_t(*this, logical_size));
+
+        // Already created by a lookup
+        if (!inserted) {
+            return arena->make<hfs_fork_t>(&it->second, logical_size, shared_from_this());
         }
-        // Special handling: also add catalog extents to catalog_ for backward compatibility
-        if (file_ID == CNID_CATALOG && forkType == 0x00) {
-            for (int i = 0; i < 3; i++) {
-                auto extent = extent_record.get_extent(i);
-                if (extent.count > 0) {
-                    catalog_.add_extent(extent);
-                }
+
+        for (int i = 0; i < 3; i++) {
+            uint16_t start = be16(catalog_extents[i].startBlock);
+            uint16_t count = be16(catalog_extents[i].blockCount);
+            if (count > 0) {
+                it->second.add_extent({start, count});
             }
-        } });
+        }
+
+        auto overflow_it = overflow_extents.find(key);
+        if (overflow_it != overflow_extents.end()) {
+            for (const auto &extent : overflow_it->second) {
+                it->second.add_extent(extent);
+            }
+        }
+
+        return arena->make<hfs_fork_t>(&it->second, logical_size, shared_from_this());
+    };
+
+    // The catalog needs all its extents before we can read it
+    complete_catalog_extents();
+
+    // The metadata of the files is only built for a visitor that can reject some of them
+    file_visitor_t *filter = visitor && visitor->has_file_filter() ? visitor : nullptr;
 
     // Now we can read the catalog B-tree and build the folder/file hierarchy
     auto catalog_btree = catalog_.as_btree_file();
+    catalog_btree.set_traversal(traversal);
 
     // Root folder has ID 2
-    root_folder = std::make_shared<Folder>(from_macroman(mdb.getVolumeName()));
-    folders[CNID_ROOT] = root_folder;
+    auto root = arena->make<Folder>(*disk, volume_name_, arena->resource());
+    std::unordered_map<uint32_t, Folder *> folders; // CNID -> folder
+    folders.reserve(std::min(folder_count_, MAX_RESERVED_ENTRIES) + 1);
+    folders[CNID_ROOT] = root;
 
-    // Local struct for tracking folder hierarchy relationships
-    struct hierarchy_t {
+    // Parent links are resolved after the catalog pass, as children can come before their parent
+    struct folder_link_t {
         uint32_t parent_id;
         uint32_t child_id;
     };
+    struct file_link_t {
+        uint32_t parent_id;
+        File *file;
+    };
     
-    std::vector<hierarchy_t> hierarchy;
+    std::vector<folder_link_t> folder_links;
+    std::vector<file_link_t> file_links;
+    folder_links.reserve(std::min(folder_count_, MAX_RESERVED_ENTRIES));
+    file_links.reserve(std::min(file_count_, MAX_RESERVED_ENTRIES));
 
-    // As files needs folders to be retained, we first create all folders
+    // Single pass on the catalog, creating both folders and files
     catalog_btree.iterate_catalog([&](
                                       const catalog_record_t *catalog_record,
                                       const catalog_record_folder_t *folder_record,
-                                      const catalog_record_file_t *)
+                                      const catalog_record_file_t *file_record)
                                   {
 
         // Skip records with parent ID 1 (these are special system records)
@@ -747,139 +1041,54 @@ void hfs_partition_t::build_root_folder()
 
         if (folder_record) {
             // This is a folder
-            auto folder = std::make_shared<Folder>(from_macroman(catalog_record->name()));
+            auto folder = arena->make<Folder>(*disk, from_macroman(catalog_record->name()), arena->resource());
             auto folder_id = folder_record->folder_id();
             folders[folder_id] = folder;
-            
-            // Record the hierarchy relationship
-            hierarchy.push_back({parent_id, folder_id});
+            folder_links.push_back({parent_id, folder_id});
 
 #ifdef VERBOSE
             std::cout << std::format("Folder: {} (ID: {}, Parent: {})\n", 
                                     catalog_record->name(), folder_id, parent_id);
 #endif
         }
-    }
-    );
-
-    
-    // We then do all the files
-    catalog_btree.iterate_catalog([&](
-                                      const catalog_record_t *catalog_record,
-                                      const catalog_record_folder_t *,
-                                      const catalog_record_file_t *file_record)
-                                  {
-
-        // Skip records with parent ID 1 (these are special system records)
-        if (catalog_record->parent_id() == 1) {
-            return;
-        }
-
-        auto parent_id = catalog_record->parent_id();
-
-        if (file_record) {
+        else if (file_record) {
             // This is a file
+            // Rejected files are dropped before anything is allocated for them
+            if (filter) {
+                file_metadata_t metadata{
+                    catalog_record->macroman_name(),
+                    file_record->type_code(),
+                    file_record->creator_code(),
+                    static_cast<uint32_t>(std::max(file_record->dataLogicalSize(), 0)),
+                    static_cast<uint32_t>(std::max(file_record->rsrcLogicalSize(), 0))};
+                if (!filter->accepts_file(metadata)) {
+                    return;
+                }
+            }
+
             uint32_t fileID = file_record->file_id();
             
-            // Build complete file extents (catalog + overflow) for each fork
-            std::unique_ptr<fork_t> data_fork;
-            std::unique_ptr<fork_t> rsrc_fork;
+            fork_t *data_fork = nullptr;
+            fork_t *rsrc_fork = nullptr;
             
             if (file_record->dataLogicalSize() > 0) {
-                // Create key for data fork
-                auto data_key = std::make_pair(fileID, static_cast<uint8_t>(0x00));
-                
-                // Get or create hfs_file_t for data fork
-                auto it = files_.find(data_key);
-                if (it == files_.end()) {
-                    // Create new hfs_file_t with logical size
-                    it = files_.emplace(data_key, hfs_file_t(*this, file_record->dataLogicalSize())).first;
-                    
-                    // Add catalog extents
-                    for (int i = 0; i < 3; i++) {
-                        uint16_t start = be16(file_record->dataExtents()[i].startBlock);
-                        uint16_t count = be16(file_record->dataExtents()[i].blockCount);
-                        if (count > 0) {
-                            it->second.add_extent({start, count});
-                        }
-                    }
-                } else {
-                    // Set logical size if not already set
-                    it->second.set_logical_size(file_record->dataLogicalSize());
-                    
-                    // Add catalog extents (these are the primary extents, extents overflow has additional ones)
-                    for (int i = 0; i < 3; i++) {
-                        uint16_t start = be16(file_record->dataExtents()[i].startBlock);
-                        uint16_t count = be16(file_record->dataExtents()[i].blockCount);
-                        if (count > 0) {
-                            it->second.add_extent({start, count});
-                        }
-                    }
-                }
-                
-                // Create adapter using the complete extents
-                data_fork = std::make_unique<hfs_fork_t>(&it->second, 
-                                                         file_record->dataLogicalSize(),
-                                                         shared_from_this());
+                data_fork = make_fork(fileID, 0x00, file_record->dataLogicalSize(), file_record->dataExtents());
             }
             
             if (file_record->rsrcLogicalSize() > 0) {
-                // Create key for resource fork
-                auto rsrc_key = std::make_pair(fileID, static_cast<uint8_t>(0xFF));
-                
-                // Get or create hfs_file_t for resource fork
-                auto it = files_.find(rsrc_key);
-                if (it == files_.end()) {
-                    // Create new hfs_file_t with logical size
-                    it = files_.emplace(rsrc_key, hfs_file_t(*this, file_record->rsrcLogicalSize())).first;
-                    
-                    // Add catalog extents
-                    for (int i = 0; i < 3; i++) {
-                        uint16_t start = be16(file_record->rsrcExtents()[i].startBlock);
-                        uint16_t count = be16(file_record->rsrcExtents()[i].blockCount);
-                        if (count > 0) {
-                            it->second.add_extent({start, count});
-                        }
-                    }
-                } else {
-                    // Set logical size if not already set
-                    it->second.set_logical_size(file_record->rsrcLogicalSize());
-                    
-                    // Add catalog extents (these are the primary extents, extents overflow has additional ones)
-                    for (int i = 0; i < 3; i++) {
-                        uint16_t start = be16(file_record->rsrcExtents()[i].startBlock);
-                        uint16_t count = be16(file_record->rsrcExtents()[i].blockCount);
-                        if (count > 0) {
-                            it->second.add_extent({start, count});
-                        }
-                    }
-                }
-                
-                // Create adapter using the complete extents
-                rsrc_fork = std::make_unique<hfs_fork_t>(&it->second, 
-                                                         file_record->rsrcLogicalSize(),
-                                                         shared_from_this());
+                rsrc_fork = make_fork(fileID, 0xFF, file_record->rsrcLogicalSize(), file_record->rsrcExtents());
             }
             
-            std::shared_ptr<File> file = std::make_shared<File>(
+            File *file = arena->make<File>(
                 disk,
                 from_macroman(catalog_record->name()),
-                file_record->type(),
-                file_record->creator(),
-                std::move(data_fork),
-                std::move(rsrc_fork));
-
-                // Find parent folder and add file to it
-            auto parent_it = folders.find(parent_id);
-            if (parent_it != folders.end()) {
-                parent_it->second->add_file(file);
-            }
-            else
-            {
-                std::cerr << std::format("Warning: Parent folder ID {} not found for file {}\n",
-                                         parent_id,
-                                         catalog_record->name());
-            }
+                file_record->type_code(),
+                file_record->creator_code(),
+                fileID,
+                data_fork,
+                rsrc_fork);
+
+            file_links.push_back({parent_id, file});
 
 #ifdef VERBOSE
             std::cout << std::format("File: {} [{}/{}] (Parent: {}, Data: {}, Rsrc: {})\n",
@@ -893,10 +1102,10 @@ void hfs_partition_t::build_root_folder()
         } });
 
     // Build the folder hierarchy
-    for (const auto &h : hierarchy)
+    for (const auto &link : folder_links)
     {
-        auto parent_it = folders.find(h.parent_id);
-        auto child_it = folders.find(h.child_id);
+        auto parent_it = folders.find(link.parent_id);
+        auto child_it = folders.find(link.child_id);
 
         if (parent_it != folders.end() && child_it != folders.end())
         {
@@ -904,7 +1113,24 @@ void hfs_partition_t::build_root_folder()
         }
     }
 
-    // All the Folder shared_ptr should now be owned by their parents folders
+    // Find parent folder and add each file to it
+    for (const auto &link : file_links)
+    {
+        auto parent_it = folders.find(link.parent_id);
+        if (parent_it != folders.end())
+        {
+            parent_it->second->add_file(link.file);
+        }
+        else
+        {
+            std::cerr << std::format("Warning: Parent folder ID {} not found for file {}\n",
+                                     link.parent_id,
+                                     link.file->name());
+        }
+    }
+
+    // Files without a folder stay in the arena until it is released
+    return object_arena_t::handle(arena, root);
 }
 
 void hfs_partition_t::readCatalogHeader(uint64_t /* catalogExtendStartBlock */)
@@ -920,6 +1146,171 @@ const hfs_file_t* hfs_partition_t::get_file(uint32_t fileID, uint8_t forkType) c
     return (it != files_.end()) ? &it->second : nullptr;
 }
 
+void hfs_partition_t::add_overflow_extents(hfs_file_t &file, uint32_t fileID, uint8_t forkType)
+{
+    auto extents_btree = extents_.as_btree_file();
+
+    // Each extents record is keyed by the file block where its first extent starts
+    uint32_t start_block = file.block_count();
+    while (start_block <= 0xffff)
+    {
+        uint32_t added = 0;
+        bool found = extents_btree.find_extents(fileID, forkType, static_cast<uint16_t>(start_block), [&](const extents_record_t &record)
+                                                {
+            for (int i = 0; i < 3; i++) {
+                auto extent = record.get_extent(i);
+                if (extent.count > 0) {
+                    file.add_extent(extent);
+                    added += extent.count;
+                }
+            } });
+        if (!found || added == 0)
+        {
+            break;
+        }
+        start_block += added;
+    }
+}
+
+void hfs_partition_t::complete_catalog_extents()
+{
+    if (!catalog_extents_complete_)
+    {
+        add_overflow_extents(catalog_, CNID_CATALOG, 0x00);
+        catalog_extents_complete_ = true;
+    }
+}
+
+fork_t *hfs_partition_t::lookup_fork(object_arena_t &arena, uint32_t fileID, uint8_t forkType, uint32_t logical_size, const HFSExtentRecord *catalog_extents)
+{
+    auto key = std::make_pair(fileID, forkType);
+    auto [it, inserted] = files_.emplace(key, hfs_file_t(*this, logical_size));
+
+    if (inserted)
+    {
+        for (int i = 0; i < 3; i++)
+        {
+            uint16_t start = be16(catalog_extents[i].startBlock);
+            uint16_t count = be16(catalog_extents[i].blockCount);
+            if (count > 0)
+            {
+                it->second.add_extent({start, count});
+            }
+        }
+        add_overflow_extents(it->second, fileID, forkType);
+    }
+
+    return arena.make<hfs_fork_t>(&it->second, logical_size, shared_from_this());
+}
+
+bool hfs_partition_t::find_thread(uint32_t cnid, uint32_t &parent_id, std::string &name)
+{
+    complete_catalog_extents();
+    auto catalog_btree = catalog_.as_btree_file();
+
+    return catalog_btree.find_thread(cnid, [&](const catalog_record_thread_t *thread_record)
+                                     {
+        parent_id = thread_record->parent_id();
+        name = from_macroman(thread_record->name()); });
+}
+
+void hfs_partition_t::prefetch()
+{
+    uint64_t allocation_offset = allocationStart_ * 512;
+    for (const hfs_file_t *btree : {&extents_, &catalog_})
+    {
+        btree->iterate_runs(0, static_cast<uint32_t>(btree->physical_size()), [&](uint64_t offset, uint32_t length)
+                            { datasource_->prefetch(allocation_offset + offset, length); });
+    }
+}
+
+std::shared_ptr<File> hfs_partition_t::find_file(const std::string &path)
+{
+    auto components = split_string(path, ':');
+    if (components.size() < 2)
+    {
+        return nullptr;
+    }
+
+    // Catalog keys hold MacRoman names, a name that cannot be converted cannot be in the catalog
+    std::vector<std::string> names;
+    try
+    {
+        for (const auto &component : components)
+        {
+            names.push_back(to_macroman(component));
+        }
+    }
+    catch (const std::invalid_argument &)
+    {
+        return nullptr;
+    }
+
+    // The path starts with the volume name, which is the name of the root folder
+    uint32_t root_parent_id;
+    std::string root_name;
+    if (!find_thread(CNID_ROOT, root_parent_id, root_name))
+    {
+        throw std::runtime_error("No thread record for the root folder");
+    }
+    root_name = to_macroman(root_name);
+    if (compare_names(reinterpret_cast<const uint8_t *>(root_name.data()), root_name.size(),
+                      reinterpret_cast<const uint8_t *>(names[0].data()), names[0].size()) != 0)
+    {
+        return nullptr;
+    }
+
+    auto catalog_btree = catalog_.as_btree_file();
+
+    uint32_t folder_id = CNID_ROOT;
+    for (size_t i = 1; i + 1 < names.size(); i++)
+    {
+        uint32_t child_id = 0;
+        catalog_btree.find_catalog(folder_id, names[i], [&](const catalog_record_t *, const catalog_record_folder_t *folder_record, const catalog_record_file_t *)
+                                   {
+            if (folder_record) {
+                child_id = folder_record->folder_id();
+            } });
+        if (!child_id)
+        {
+            return nullptr;
+        }
+        folder_id = child_id;
+    }
+
+    std::shared_ptr<File> file;
+    catalog_btree.find_catalog(folder_id, names.back(), [&](const catalog_record_t *catalog_record, const catalog_record_folder_t *, const catalog_record_file_t *file_record)
+                               {
+        if (!file_record) {
+            return;
+        }
+
+        // The file is alone in its arena, it has no folder
+        auto arena = std::make_shared<object_arena_t>();
+        uint32_t fileID = file_record->file_id();
+        fork_t *data_fork = nullptr;
+        fork_t *rsrc_fork = nullptr;
+
+        if (file_record->dataLogicalSize() > 0) {
+            data_fork = lookup_fork(*arena, fileID, 0x00, file_record->dataLogicalSize(), file_record->dataExtents());
+        }
+
+        if (file_record->rsrcLogicalSize() > 0) {
+            rsrc_fork = lookup_fork(*arena, fileID, 0xFF, file_record->rsrcLogicalSize(), file_record->rsrcExtents());
+        }
+
+        file = object_arena_t::handle(arena, arena->make<File>(
+            std::make_shared<Disk>(volume_name_, datasource_->description(), datasource_->fingerprint()),
+            from_macroman(catalog_record->name()),
+            file_record->type_code(),
+            file_record->creator_code(),
+            fileID,
+            data_fork,
+            rsrc_fork)); });
+
+    return file;
+}
+
 void hfs_partition_t::readCatalogRoot(uint16_t /* rootNode */)
 {
     // Implementation integrated into build_root_folder()
@@ -979,8 +1370,141 @@ btree_file_t::btree_file_t(hfs_file_t &file) : file_(file)
 
     first_leaf_node_ = header2.first_leaf_node();
     node_size_ = header2.node_size();
+    node_count_ = header2.node_count();
+    root_node_ = header2.root_node();
+    tree_depth_ = header2.tree_depth();
 
 #ifdef VERBOSE
     std::cout << std::format("First leaf node: {}\n", header2.first_leaf_node());
 #endif
-}
\ No newline at end of file
+}
+
+block_t btree_file_t::read_node(uint32_t node_index)
+{
+    uint32_t file_offset = node_index * node_size_;
+    uint64_t allocation_offset = file_.allocation_offset(file_offset);
+#ifdef VERBOSE
+    std::cout << std::format("read_node({}) - file offset: {}, allocation offset: {}, node size: {}\n", node_index, file_offset, allocation_offset, node_size_);
+#endif
+    return file_.partition().read_allocation(allocation_offset, node_size_);
+}
+
+std::vector<block_t> btree_file_t::read_all_nodes()
+{
+    //  Never trust the node count further than the extents of the file
+    uint64_t node_count = std::min<uint64_t>(node_count_, file_.physical_size() / node_size_);
+
+    std::vector<block_t> nodes;
+    nodes.reserve(node_count);
+
+    uint64_t run_position = 0;
+    file_.iterate_runs(0, static_cast<uint32_t>(node_count * node_size_), [&](uint64_t allocation_offset, uint32_t length)
+                       {
+        uint64_t run_end = run_position + length;
+        uint64_t position = nodes.size() * node_size_;
+
+        //  A node that straddles the boundary with the previous run is assembled
+        if (position < run_position)
+        {
+            nodes.push_back(block_t(file_.read(static_cast<uint32_t>(position), node_size_)));
+            position += node_size_;
+        }
+
+        while (position + node_size_ <= run_end)
+        {
+            uint64_t chunk_nodes = std::min<uint64_t>((run_end - position) / node_size_, SCAN_CHUNK_SIZE / node_size_);
+            block_t chunk = file_.partition().read_allocation_uncached(allocation_offset + (position - run_position),
+                                                                       static_cast<uint32_t>(chunk_nodes * node_size_));
+            for (uint64_t i = 0; i != chunk_nodes; i++)
+            {
+                nodes.push_back(chunk.sub_block(i * node_size_, node_size_));
+            }
+            position += chunk_nodes * node_size_;
+        }
+
+        run_position = run_end; });
+
+    return nodes;
+}
+
+std::vector<bool> btree_file_t::used_nodes(std::vector<block_t> &nodes) const
+{
+    std::vector<bool> used(nodes.size(), false);
+    size_t bit = 0;
+
+    //  The header node holds the first map record (record 2),
+    //  further map records are in map nodes chained from the header with fLink
+    uint32_t node_index = 0;
+    uint16_t record_index = 2;
+    size_t visited = 0;
+
+    while (node_index < nodes.size() && visited++ < nodes.size())
+    {
+        btree_leaf_node_t node(nodes[node_index]);
+        if (node.num_records() <= record_index)
+        {
+            break;
+        }
+        //  get_record counts from the end of the offset table
+        auto [ptr, size] = node.get_record(node.num_records() - 1 - record_index);
+        if (static_cast<const uint8_t *>(ptr) + size > static_cast<const uint8_t *>(nodes[node_index].data()) + node_size_)
+        {
+            break;
+        }
+
+        const uint8_t *map = static_cast<const uint8_t *>(ptr);
+        for (size_t i = 0; i != size * 8u && bit < used.size(); i++, bit++)
+        {
+            used[bit] = (map[i / 8] >> (7 - i % 8)) & 1;
+        }
+
+        node_index = node.f_link();
+        if (node_index == 0 || node_index >= nodes.size() || btree_leaf_node_t(nodes[node_index]).kind() != ndMapNode)
+        {
+            break;
+        }
+        record_index = 0;
+    }
+
+    //  No usable map: consider every node used
+    if (bit == 0)
+    {
+        used.assign(nodes.size(), true);
+    }
+
+    return used;
+}
+
+std::vector<uint32_t> btree_file_t::chain_order(std::vector<block_t> &nodes, const std::vector<uint32_t> &leaves) const
+{
+    std::vector<bool> is_leaf(nodes.size(), false);
+    for (auto index : leaves)
+    {
+        is_leaf[index] = true;
+    }
+
+    std::vector<uint32_t> result;
+    result.reserve(leaves.size());
+
+    std::vector<bool> visited(nodes.size(), false);
+    for (uint32_t index = first_leaf_node_; index < nodes.size() && is_leaf[index] && !visited[index];)
+    {
+        visited[index] = true;
+        result.push_back(index);
+        index = btree_leaf_node_t(nodes[index]).f_link();
+    }
+
+    if (result.size() != leaves.size())
+    {
+        rs_log("Leaf chain is broken, recovering {} unchained leaf nodes", leaves.size() - result.size());
+        for (auto index : leaves)
+        {
+            if (!visited[index])
+            {
+                result.push_back(index);
+            }
+        }
+    }
+
+    return result;
+}
@@ -8,6 +8,7 @@
 #include <cstdint>
 #include <iomanip>
 #include <map>
+#include <unordered_map>
 #include <algorithm>
 #include <array>
 #include <memory>
@@ -24,6 +25,7 @@
 #include "data/data.h"
 #include "partition.h"
 #include "hfs/hfs_fork.h"
+#include "utils/object_arena.h"
 
 #define noVERBOSE
 
@@ -58,9 +60,18 @@ public:
 
 private:
 	std::vector<extent_t> extents_;
+	std::vector<uint32_t> extent_first_block_;  ///< File-relative first block of each extent (prefix sums of the counts)
+	uint32_t block_count_ = 0;                  ///< Total number of allocation blocks in all extents
 	hfs_partition_t &partition_;
 	uint32_t logical_size_ = 0;
 
+	/**
+	 * Find the extent containing a file-relative block (binary search).
+	 * @param block File-relative block number
+	 * @return Index of the extent in extents_
+	 */
+	size_t extent_index(uint32_t block) const;
+
 public:
 	/**
 	 * Construct an HFS file associated with a partition.
@@ -96,9 +107,9 @@ public:
 	hfs_partition_t &partition() { return partition_; }
 	
 	/**
-	 * Convert a file-relative block number to absolute disk block.
+	 * Convert a file-relative block number to its allocation block number.
 	 * @param block File-relative block number
-	 * @return Absolute block number on disk
+	 * @return Allocation block number
 	 */
 	uint16_t to_absolute_block(uint16_t block) const;
 
@@ -109,6 +120,17 @@ public:
 	 */
 	uint64_t allocation_offset(uint32_t offset) const;
 
+	/**
+	 * Iterate over the contiguous runs covering a byte range of the file.
+	 * Physically adjacent extents are merged into a single run.
+	 * @param offset Byte offset within the file
+	 * @param size Number of bytes
+	 * @param callback Called with (allocation space offset, length) for each run, in file order
+	 * @throws std::out_of_range if the range is not covered by the extents
+	 */
+	template <typename F>
+	void iterate_runs(uint32_t offset, uint32_t size, F &&callback) const;
+
 	/**
 	 * Set the logical size of this file.
 	 * @param size Logical size in bytes
@@ -123,6 +145,18 @@ public:
 	 */
 	uint32_t logical_size() const { return logical_size_; }
 
+	/**
+	 * Get the number of allocation blocks in all the extents of this file.
+	 * @return Number of allocation blocks
+	 */
+	uint32_t block_count() const { return block_count_; }
+
+	/**
+	 * Get the number of bytes covered by the extents of this file.
+	 * @return Physical size in bytes
+	 */
+	uint64_t physical_size() const;
+
 	/**
 	 * Read the entire file content.
 	 * @return Vector containing all file data
@@ -167,9 +201,13 @@ class hfs_partition_t : public partition_t, public std::enable_shared_from_this<
 	std::shared_ptr<datasource_t> datasource_;
 	uint64_t allocationStart_ = 0;
 	uint64_t allocationBlockSize_ = 512;
+	std::string volume_name_;
+	uint32_t file_count_ = 0;   ///< Number of files in the volume, according to the MDB
+	uint32_t folder_count_ = 0; ///< Number of folders in the volume, according to the MDB
 
 	hfs_file_t extents_;
 	hfs_file_t catalog_;
+	bool catalog_extents_complete_ = false; ///< True once the overflow extents of the catalog have been added
 	
 	// Map to store complete files: (fileID, forkType) -> hfs_file_t
 	// forkType: 0 = data fork, 0xFF = resource fork
@@ -190,13 +228,15 @@ class hfs_partition_t : public partition_t, public std::enable_shared_from_this<
 
 	/**
 	 * Build the root folder by parsing HFS catalog and extents B-trees.
-	 * Creates the complete file and folder hierarchy.
+	 * Creates the file and folder hierarchy in a single catalog pass.
 	 * Must be called after the object is managed by a shared_ptr.
+	 * @param visitor If set, files it does not accept are skipped using their catalog record only
+	 *                (see file_visitor_t::has_file_filter)
+	 * @return The root folder
 	 */
-	void build_root_folder();
+	std::shared_ptr<Folder> build_root_folder(file_visitor_t *visitor = nullptr);
 
-	std::shared_ptr<Folder> root_folder;
-	std::map<uint32_t, std::shared_ptr<Folder>> folders;
+	std::weak_ptr<Folder> root_folder; ///< Complete hierarchy, while it is in use (its forks keep the partition alive)
 
 	/**
 	 * Get a complete file with all extents.
@@ -206,6 +246,32 @@ class hfs_partition_t : public partition_t, public std::enable_shared_from_this<
 	 */
 	const hfs_file_t* get_file(uint32_t fileID, uint8_t forkType) const;
 
+	/**
+	 * Add the extents found in the extents B-tree after the current extents of a file.
+	 * Records are looked up by key, without scanning the extents B-tree.
+	 * @param file File to complete
+	 * @param fileID HFS file ID
+	 * @param forkType Fork type (0=data, 0xFF=resource)
+	 */
+	void add_overflow_extents(hfs_file_t &file, uint32_t fileID, uint8_t forkType);
+
+	/**
+	 * Add the overflow extents of the catalog file, so that all of it can be read.
+	 * Does nothing if already done.
+	 */
+	void complete_catalog_extents();
+
+	/**
+	 * Create the fork of a file found with a catalog lookup.
+	 * @param arena Arena of the file
+	 * @param fileID HFS file ID
+	 * @param forkType Fork type (0=data, 0xFF=resource)
+	 * @param logical_size Logical size of the fork in bytes
+	 * @param catalog_extents The 3 extents of the fork in its catalog record
+	 * @return The fork, owned by the arena
+	 */
+	fork_t *lookup_fork(object_arena_t &arena, uint32_t fileID, uint8_t forkType, uint32_t logical_size, const HFSExtentRecord *catalog_extents);
+
 public:
 	/**
 	 * Construct HFS partition from a data source.
@@ -213,12 +279,6 @@ public:
 	 */
 	hfs_partition_t(std::shared_ptr<datasource_t> datasource);
 
-	/**
-	 * Complete the initialization by building files and folders.
-	 * Must be called after the object is managed by a shared_ptr.
-	 */
-	void complete_initialization() { build_root_folder(); }
-
 	/**
 	 * Get the underlying data source.
 	 * @return Reference to the data source
@@ -229,7 +289,51 @@ public:
 	 * Get the root folder of this HFS volume.
 	 * @return Shared pointer to the root folder
 	 */
-	std::shared_ptr<Folder> get_root_folder() override { return root_folder; }
+	std::shared_ptr<Folder> get_root_folder() override
+	{
+		auto root = root_folder.lock();
+		if (!root)
+		{
+			root = build_root_folder();
+			root_folder = root;
+		}
+		return root;
+	}
+
+	/**
+	 * Get a root folder holding only the files accepted by a visitor.
+	 * The catalog records are checked before any File or fork is created.
+	 * @param visitor The visitor that will visit the folder
+	 * @return Shared pointer to the root folder
+	 */
+	std::shared_ptr<Folder> get_root_folder_for(file_visitor_t &visitor) override
+	{
+		auto root = root_folder.lock();
+		return root ? root : build_root_folder(&visitor);
+	}
+
+	/**
+	 * Find a file from its path, using catalog B-tree lookups.
+	 * Only the nodes on the way to each path component are read,
+	 * the folder hierarchy is not built.
+	 * @param path Colon separated path, starting with the volume name
+	 * @return The file, or nullptr if there is no file at that path
+	 */
+	std::shared_ptr<File> find_file(const std::string &path) override;
+
+	/**
+	 * Prefetch the catalog and extents B-trees, as far as the MDB extents describe them.
+	 */
+	void prefetch() override;
+
+	/**
+	 * Find the parent and the name of a folder (or file) from its thread record.
+	 * @param cnid Catalog node ID of the folder or file
+	 * @param parent_id Receives the CNID of the parent folder
+	 * @param name Receives the name, converted to UTF-8
+	 * @return True if a thread record was found
+	 */
+	bool find_thread(uint32_t cnid, uint32_t &parent_id, std::string &name);
 	
 	/**
 	 * Check if a data source contains an HFS partition.
@@ -292,6 +396,47 @@ public:
 		return datasource_->read_block(disk_offset, size);
 	}
 
+	/**
+	 * Read data from the allocation zone without going through the page cache.
+	 * Used by the sequential B-tree scans, whose chunks would flush the cached nodes.
+	 * @param offset Byte offset within allocation zone
+	 * @param size Number of bytes to read
+	 */
+	block_t read_allocation_uncached(uint64_t offset, uint32_t size) {
+		if (!datasource_) {
+			throw std::runtime_error("Null datasource");
+		}
+
+		uint64_t disk_offset = static_cast<uint64_t>(allocationStart_) * 512 + offset;
+
+		if (disk_offset + size > datasource_->size()) {
+			throw std::out_of_range("Read beyond partition bounds");
+		}
+
+		return datasource_->read_block_uncached(disk_offset, size);
+	}
+
+	/**
+	 * Read data from the allocation zone directly into a buffer.
+	 * Unlike read_allocation, the full size is always read.
+	 * @param offset Byte offset within allocation zone
+	 * @param size Number of bytes to read
+	 * @param buffer Destination, must hold at least size bytes
+	 */
+	void read_allocation_into(uint64_t offset, uint32_t size, uint8_t *buffer) {
+		if (!datasource_) {
+			throw std::runtime_error("Null datasource");
+		}
+
+		uint64_t disk_offset = static_cast<uint64_t>(allocationStart_) * 512 + offset;
+
+		if (disk_offset + size > datasource_->size()) {
+			throw std::out_of_range("Read beyond partition bounds");
+		}
+
+		datasource_->read_into(disk_offset, size, buffer);
+	}
+
 	/**
 	 * Read catalog header (legacy method).
 	 * @param catalogExtendStartBlock Starting block of catalog
@@ -310,3 +455,37 @@ public:
 	void dumpextentTree();
 };
 
+template <typename F>
+void hfs_file_t::iterate_runs(uint32_t offset, uint32_t size, F &&callback) const
+{
+	uint64_t allocation_block_size = partition_.allocation_block_size();
+	uint64_t position = offset;
+	uint64_t end = position + size;
+
+	if (end > block_count_ * allocation_block_size)
+	{
+		throw std::out_of_range("Offset out of range");
+	}
+
+	if (size == 0)
+	{
+		return;
+	}
+
+	size_t index = extent_index(static_cast<uint32_t>(position / allocation_block_size));
+	while (position < end)
+	{
+		uint64_t run_position = extent_first_block_[index] * allocation_block_size;
+		uint64_t run_start = extents_[index].start;
+		uint64_t run_blocks = extents_[index].count;
+		for (index++; index < extents_.size() && extents_[index].start == run_start + run_blocks; index++)
+		{
+			run_blocks += extents_[index].count;
+		}
+
+		uint64_t offset_in_run = position - run_position;
+		uint64_t length = std::min(run_blocks * allocation_block_size - offset_in_run, end - position);
+		callback(run_start * allocation_block_size + offset_in_run, static_cast<uint32_t>(length));
+		position += length;
+	}
+}
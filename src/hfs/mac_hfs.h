@@ -174,6 +174,16 @@ struct HFSCatalogFile
     uint32_t reserved;              // Reserved - initialized as zero
 };
 
+// HFS Catalog Thread Record - 46 bytes
+// Keyed by the CNID of a folder (or file) with an empty name, it gives its parent and name
+struct HFSCatalogThread
+{
+    int16_t recordType;             // Record type (0x0300 = folder thread, 0x0400 = file thread)
+    int32_t reserved[2];            // Reserved - initialized as zero
+    uint32_t parentID;              // Parent ID of the folder or file
+    uint8_t nodeName[32];           // Name of the folder or file (Pascal string)
+};
+
 // Apple Partition Map entry
 struct ApplePartitionMapEntry
 {
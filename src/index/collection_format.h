@@ -0,0 +1,159 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+//  On-disk layout of a collection index (.rsx file)
+//
+//  header | images | partitions | folders | files | string pool | trigrams | postings
+//         | types | creators | containers | container words
+//
+//  Each section is an array of fixed size records starting on an 8 bytes boundary,
+//  so an index is used straight from a read-only memory mapping, without parsing.
+//  Records refer to each other by index in their section, and to strings by offset
+//  in the string pool, where each string is stored as a 32 bits length followed by its bytes.
+//  Identical strings are stored once.
+//  The trigrams and postings sections are an inverted index of the case folded names (see fold_case):
+//  each trigram of a name lists the files and folders whose folded name contains it.
+//  The types, creators, containers and container words sections are compressed bitmaps
+//  of the files of each type and creator code, in the way of roaring bitmaps:
+//  file numbers are split into chunks of 65536 by their high 16 bits, and each chunk with files
+//  is a container, either a sorted array of the low 16 bits or, when it has more than
+//  RSX_ARRAY_CONTAINER_MAX files, a bitmap of the whole chunk.
+//  Integers are in host byte order: an index is not meant to be moved between machines,
+//  and the magic does not match when it is read on a machine of the other endianness.
+
+static const char RSX_MAGIC[8] = {'R', 'S', 'X', 'I', 'N', 'D', 'E', 'X'};
+static const uint32_t RSX_VERSION = 5;
+
+//  Value of a reference to a missing record or string
+static const uint32_t RSX_NONE = 0xffffffff;
+
+//  Flags of the header
+static const uint32_t RSX_CONTENT_KEYS = 1; // The files have a content key
+static const uint32_t RSX_XXH64_KEYS = 2;   // The content keys hash the forks with XXH64 instead of MD5
+
+//  Flags of an image
+static const uint32_t RSX_IMAGE_DELETED = 1; // Tombstone of an image that was indexed, then not found by an update
+
+//  Most files in an array container, larger ones are bitmaps of RSX_CHUNK_WORDS words
+static const uint32_t RSX_ARRAY_CONTAINER_MAX = 4096;
+static const uint32_t RSX_CHUNK_WORDS = 65536 / 64;
+
+//  Number of bytes at the start of an image covered by its header hash
+//  It holds the partition map and the MDB, whose modification date changes with any write to an HFS volume
+static const uint64_t RSX_HEADER_HASH_SIZE = 64 * 1024;
+
+struct rsx_section_t
+{
+    uint64_t offset; // Offset of the first record in the file
+    uint64_t count;  // Number of records (bytes for the string pool)
+};
+
+struct rsx_header_t
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+    rsx_section_t images;
+    rsx_section_t partitions;
+    rsx_section_t folders;
+    rsx_section_t files;
+    rsx_section_t strings;
+    rsx_section_t trigrams;
+    rsx_section_t postings;
+    rsx_section_t types;
+    rsx_section_t creators;
+    rsx_section_t containers;
+    rsx_section_t container_words;
+};
+
+//  A disk image file
+//  The size, modification time, inode and header hash tell if the file changed since it was indexed
+struct rsx_image_t
+{
+    uint32_t path;            // String
+    uint32_t first_partition; // Partitions of an image are contiguous
+    uint32_t partition_count;
+    uint32_t flags;
+    uint64_t size;           // Size of the file in bytes
+    int64_t mtime;           // Modification time, in nanoseconds since the epoch
+    uint64_t inode;
+    uint8_t header_hash[16]; // MD5 of the first RSX_HEADER_HASH_SIZE bytes
+};
+
+//  A mounted volume of a disk image
+struct rsx_partition_t
+{
+    uint32_t image;
+    uint32_t disk_name;    // String, name of the Disk of the files (RSX_NONE if the partition has no file)
+    uint32_t disk_path;    // String, path of the Disk of the files
+    uint32_t first_folder; // Folders and files of a partition are contiguous, in the order of a visit
+    uint32_t folder_count;
+    uint32_t first_file;
+    uint32_t file_count;
+    uint32_t reserved;
+};
+
+struct rsx_folder_t
+{
+    uint32_t name;        // String, sanitized like Folder::name()
+    uint32_t parent;      // RSX_NONE for the root folder of a partition
+    uint32_t folded_name; // String, case folded name
+    uint32_t reserved;
+};
+
+struct rsx_file_t
+{
+    uint32_t name;   // String, File::original_name()
+    uint32_t folder;
+    uint32_t partition;
+    uint32_t type;    // Raw four characters code, File::type_code() (see rsx_code)
+    uint32_t creator; // Raw four characters code, File::creator_code()
+    uint32_t data_size;
+    uint32_t rsrc_size;
+    uint32_t content_key; // String, File::content_key() (RSX_NONE if the index has no content keys)
+    uint32_t folded_name; // String, case folded File::name()
+    uint32_t reserved;
+};
+
+//  The postings of a trigram, sorted by trigram
+//  Postings are sorted entry numbers: files first, then folders numbered from the number of files
+struct rsx_trigram_t
+{
+    uint32_t trigram; // Three bytes of a folded name, first one in the high bits (see rsx_trigram)
+    uint32_t count;   // Number of postings
+    uint64_t first;   // Index of the first posting
+};
+
+//  The files of a type or creator code, sorted by code
+struct rsx_code_t
+{
+    uint32_t code;
+    uint32_t count;           // Number of files
+    uint32_t first_container; // Containers of a code are contiguous, sorted by key
+    uint32_t container_count;
+};
+
+//  The files of a code in a chunk of 65536 file numbers
+struct rsx_container_t
+{
+    uint16_t key; // High 16 bits of the file numbers
+    uint16_t reserved;
+    uint32_t count; // Number of files, up to RSX_ARRAY_CONTAINER_MAX for an array container
+    uint64_t first; // Index of the first container word
+};
+
+//  Packs a four characters code, first character in the high bits like an OSType
+inline uint32_t rsx_code(std::string_view chars)
+{
+    return (uint32_t(uint8_t(chars[0])) << 24) | (uint32_t(uint8_t(chars[1])) << 16) |
+           (uint32_t(uint8_t(chars[2])) << 8) | uint32_t(uint8_t(chars[3]));
+}
+
+//  Packs three consecutive bytes of a folded name into a trigram
+inline uint32_t rsx_trigram(const char *bytes)
+{
+    return (uint32_t(uint8_t(bytes[0])) << 16) | (uint32_t(uint8_t(bytes[1])) << 8) | uint32_t(uint8_t(bytes[2]));
+}
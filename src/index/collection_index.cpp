@@ -0,0 +1,289 @@
+#include "index/collection_index.h"
+#include "data/mmap_datasource.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <cstring>
+#include <format>
+#include <stdexcept>
+#include <vector>
+
+//  Maps the whole file (the block keeps the mapping alive)
+static block_t map_file(const std::filesystem::path &path)
+{
+    mmap_datasource_t source(path);
+    if (source.size() < sizeof(rsx_header_t))
+    {
+        throw std::runtime_error("Not an index file: " + path.string());
+    }
+    return source.read_block(0, source.size());
+}
+
+collection_index_t::collection_index_t(const std::filesystem::path &path)
+    : data_(map_file(path)), header_(static_cast<const rsx_header_t *>(data_.data()))
+{
+    if (std::memcmp(header_->magic, RSX_MAGIC, sizeof(RSX_MAGIC)) != 0)
+    {
+        throw std::runtime_error("Not an index file: " + path.string());
+    }
+    if (header_->version != RSX_VERSION)
+    {
+        throw std::runtime_error(std::format("Unsupported index version {} (expected {}), rebuild the index: {}",
+                                             header_->version, RSX_VERSION, path.string()));
+    }
+
+    // Check all sections and references once, so the accessors cannot fail later
+    auto all_images = images();
+    auto all_partitions = partitions();
+    auto all_folders = folders();
+    section(header_->strings, 1);
+    auto all_files = files();
+    for (const auto &image : all_images)
+    {
+        if (uint64_t(image.first_partition) + image.partition_count > all_partitions.size())
+        {
+            throw std::runtime_error("Corrupted index: partitions out of range");
+        }
+    }
+    for (const auto &partition : all_partitions)
+    {
+        if (partition.image >= all_images.size() ||
+            uint64_t(partition.first_folder) + partition.folder_count > all_folders.size() ||
+            uint64_t(partition.first_file) + partition.file_count > all_files.size())
+        {
+            throw std::runtime_error("Corrupted index: partition out of range");
+        }
+    }
+    for (const auto &folder : all_folders)
+    {
+        if (folder.parent != RSX_NONE && folder.parent >= all_folders.size())
+        {
+            throw std::runtime_error("Corrupted index: folder out of range");
+        }
+    }
+    for (const auto &file : all_files)
+    {
+        if (file.partition >= all_partitions.size() || (file.folder != RSX_NONE && file.folder >= all_folders.size()))
+        {
+            throw std::runtime_error("Corrupted index: file out of range");
+        }
+    }
+    auto all_containers = containers();
+    auto all_words = container_words();
+    for (auto codes : {types(), creators()})
+    {
+        for (const auto &code : codes)
+        {
+            if (code.first_container > all_containers.size() || code.container_count > all_containers.size() - code.first_container)
+            {
+                throw std::runtime_error("Corrupted index: containers out of range");
+            }
+        }
+    }
+    for (const auto &container : all_containers)
+    {
+        uint64_t size = container.count > RSX_ARRAY_CONTAINER_MAX ? RSX_CHUNK_WORDS : (container.count + 3) / 4;
+        if (container.count > 65536 || container.first > all_words.size() || size > all_words.size() - container.first)
+        {
+            throw std::runtime_error("Corrupted index: container out of range");
+        }
+    }
+    // Posting values are only checked when they are used, as there are many of them
+    auto all_postings = postings();
+    for (const auto &trigram : trigrams())
+    {
+        if (trigram.first > all_postings.size() || trigram.count > all_postings.size() - trigram.first)
+        {
+            throw std::runtime_error("Corrupted index: postings out of range");
+        }
+    }
+}
+
+const uint8_t *collection_index_t::section(const rsx_section_t &section, size_t record_size) const
+{
+    if (section.offset > data_.size() || section.count > (data_.size() - section.offset) / record_size)
+    {
+        throw std::runtime_error("Corrupted index: section beyond end of file");
+    }
+    return static_cast<const uint8_t *>(data_.data()) + section.offset;
+}
+
+std::string_view collection_index_t::string(uint32_t offset) const
+{
+    if (offset == RSX_NONE)
+    {
+        return {};
+    }
+
+    const uint8_t *pool = static_cast<const uint8_t *>(data_.data()) + header_->strings.offset;
+    uint64_t pool_size = header_->strings.count;
+
+    uint32_t length;
+    if (offset + sizeof(length) > pool_size)
+    {
+        throw std::runtime_error("Corrupted index: string beyond end of pool");
+    }
+    std::memcpy(&length, pool + offset, sizeof(length));
+    if (offset + sizeof(length) + length > pool_size)
+    {
+        throw std::runtime_error("Corrupted index: string beyond end of pool");
+    }
+    return {reinterpret_cast<const char *>(pool + offset + sizeof(length)), length};
+}
+
+std::span<const uint32_t> collection_index_t::postings(uint32_t trigram) const
+{
+    auto all_trigrams = trigrams();
+    auto it = std::lower_bound(all_trigrams.begin(), all_trigrams.end(), trigram, [](const auto &entry, uint32_t value)
+                               { return entry.trigram < value; });
+    if (it == all_trigrams.end() || it->trigram != trigram)
+    {
+        return {};
+    }
+    return postings().subspan(it->first, it->count);
+}
+
+std::vector<uint32_t> collection_index_t::find_entries(const std::string &pattern, uint32_t first, uint32_t end) const
+{
+    auto folded_pattern = fold_case(pattern);
+    auto all_files = files();
+    auto all_folders = folders();
+
+    auto matches = [&](uint32_t entry)
+    {
+        if (entry >= all_files.size() + all_folders.size())
+        {
+            throw std::runtime_error("Corrupted index: posting out of range");
+        }
+        auto folded_name = entry < all_files.size() ? all_files[entry].folded_name : all_folders[entry - all_files.size()].folded_name;
+        return matches_name_pattern(string(folded_name), folded_pattern);
+    };
+
+    //  Trigrams of the literal parts of the pattern, which any matching name contains
+    std::vector<uint32_t> pattern_trigrams;
+    for (const auto &literal : split_string(folded_pattern, '*'))
+    {
+        for (const auto &part : split_string(literal, '?'))
+        {
+            for (size_t i = 0; i + 3 <= part.size(); i++)
+            {
+                pattern_trigrams.push_back(rsx_trigram(part.data() + i));
+            }
+        }
+    }
+    std::sort(pattern_trigrams.begin(), pattern_trigrams.end());
+    pattern_trigrams.erase(std::unique(pattern_trigrams.begin(), pattern_trigrams.end()), pattern_trigrams.end());
+
+    std::vector<uint32_t> result;
+    if (pattern_trigrams.empty())
+    {
+        for (uint32_t entry = first; entry != end; entry++)
+        {
+            if (matches(entry))
+            {
+                result.push_back(entry);
+            }
+        }
+        return result;
+    }
+
+    //  Intersect the lists, walking the shortest one and searching forward in the others
+    std::vector<std::span<const uint32_t>> lists;
+    for (auto trigram : pattern_trigrams)
+    {
+        lists.push_back(postings(trigram));
+    }
+    std::sort(lists.begin(), lists.end(), [](const auto &a, const auto &b)
+              { return a.size() < b.size(); });
+
+    auto shortest = lists[0];
+    auto from = std::lower_bound(shortest.begin(), shortest.end(), first);
+    auto to = std::lower_bound(from, shortest.end(), end);
+    std::vector<std::span<const uint32_t>::iterator> cursors;
+    for (const auto &list : lists)
+    {
+        cursors.push_back(list.begin());
+    }
+    for (auto candidate = from; candidate != to; ++candidate)
+    {
+        bool in_all = true;
+        for (size_t i = 1; i != lists.size() && in_all; i++)
+        {
+            cursors[i] = std::lower_bound(cursors[i], lists[i].end(), *candidate);
+            in_all = cursors[i] != lists[i].end() && *cursors[i] == *candidate;
+        }
+        if (in_all && matches(*candidate))
+        {
+            result.push_back(*candidate);
+        }
+    }
+    return result;
+}
+
+code_bitmap_t collection_index_t::code_files(std::span<const rsx_code_t> codes, uint32_t code) const
+{
+    auto it = std::lower_bound(codes.begin(), codes.end(), code, [](const auto &entry, uint32_t value)
+                               { return entry.code < value; });
+    if (it == codes.end() || it->code != code)
+    {
+        return {{}, container_words().data()};
+    }
+    return files(*it);
+}
+
+std::vector<uint32_t> collection_index_t::find_files(const std::string &pattern) const
+{
+    return find_entries(pattern, 0, static_cast<uint32_t>(files().size()));
+}
+
+std::vector<uint32_t> collection_index_t::find_folders(const std::string &pattern) const
+{
+    uint32_t file_count = static_cast<uint32_t>(files().size());
+    auto result = find_entries(pattern, file_count, file_count + static_cast<uint32_t>(folders().size()));
+    for (auto &entry : result)
+    {
+        entry -= file_count;
+    }
+    return result;
+}
+
+uint32_t collection_index_t::folder_partition(uint32_t folder) const
+{
+    //  Folders of the partitions are contiguous and in order, so the partition is the last one starting before the folder
+    auto all_partitions = partitions();
+    auto it = std::upper_bound(all_partitions.begin(), all_partitions.end(), folder, [](uint32_t value, const auto &partition)
+                               { return value < partition.first_folder; });
+    if (it == all_partitions.begin() || folder - (it - 1)->first_folder >= (it - 1)->folder_count)
+    {
+        throw std::runtime_error("Corrupted index: folder outside of partitions");
+    }
+    return static_cast<uint32_t>(it - 1 - all_partitions.begin());
+}
+
+std::string collection_index_t::folder_path(uint32_t folder) const
+{
+    auto all_folders = folders();
+
+    // Parents are collected from the folder up, at most once per folder of the index
+    std::vector<uint32_t> chain;
+    while (folder != RSX_NONE && chain.size() <= all_folders.size())
+    {
+        if (folder >= all_folders.size())
+        {
+            throw std::runtime_error("Corrupted index: folder out of range");
+        }
+        chain.push_back(folder);
+        folder = all_folders[folder].parent;
+    }
+
+    std::string result;
+    for (auto it = chain.rbegin(); it != chain.rend(); ++it)
+    {
+        if (it != chain.rbegin())
+        {
+            result += ":";
+        }
+        result += string(all_folders[*it].name);
+    }
+    return result;
+}
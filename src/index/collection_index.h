@@ -0,0 +1,178 @@
+#pragma once
+
+#include "index/collection_format.h"
+#include "data/data.h"
+#include "utils/hasher.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * The files of a type or creator code, as stored in an index.
+ */
+struct code_bitmap_t
+{
+    std::span<const rsx_container_t> containers; // Sorted by key, empty if no file has the code
+    const uint64_t *words;                       // Container words of the index
+
+    /**
+     * Get the low 16 bits of the file numbers of an array container.
+     * @param container A container with at most RSX_ARRAY_CONTAINER_MAX files
+     * @return Its sorted values
+     */
+    std::span<const uint16_t> array(const rsx_container_t &container) const
+    {
+        return {reinterpret_cast<const uint16_t *>(words + container.first), container.count};
+    }
+};
+
+/**
+ * Read-only access to a collection index.
+ * The index file is memory mapped, and its records are used in place.
+ */
+class collection_index_t
+{
+    block_t data_; // The whole file, kept mapped
+    const rsx_header_t *header_;
+
+    /**
+     * Get the records of a section, after checking that they are inside the file.
+     * @param section The section
+     * @param record_size Size of a record in bytes
+     * @return Pointer to the first record
+     * @throws std::runtime_error if the section is outside of the file
+     */
+    const uint8_t *section(const rsx_section_t &section, size_t record_size) const;
+
+    template <typename T>
+    std::span<const T> records(const rsx_section_t &section) const
+    {
+        return {reinterpret_cast<const T *>(this->section(section, sizeof(T))), static_cast<size_t>(section.count)};
+    }
+
+    /**
+     * Find the entries of a range whose folded name matches a pattern.
+     * Candidates come from the postings of the trigrams of the pattern, or from all entries
+     * when the pattern has no three consecutive literal characters.
+     * @param pattern The pattern, as for matches_name_pattern, not folded
+     * @param first First entry of the range (files, then folders, as in the postings)
+     * @param end End of the range
+     * @return The matching entries, sorted
+     */
+    std::vector<uint32_t> find_entries(const std::string &pattern, uint32_t first, uint32_t end) const;
+
+    /**
+     * Get the files of a code.
+     * @param codes The types or the creators of the index
+     * @param code The code
+     * @return Its bitmap, empty if no file has the code
+     */
+    code_bitmap_t code_files(std::span<const rsx_code_t> codes, uint32_t code) const;
+
+public:
+    /**
+     * Open an index.
+     * @param path Path of the index file
+     * @throws std::runtime_error if the file is not an index, or was written by an incompatible version
+     */
+    explicit collection_index_t(const std::filesystem::path &path);
+
+    /**
+     * Check if the files of the index have a content key.
+     * @return True if the index was built with content keys
+     */
+    bool has_content_keys() const { return header_->flags & RSX_CONTENT_KEYS; }
+
+    /**
+     * Get the hash of the forks in the content keys.
+     * @return The algorithm the index was built with
+     */
+    hash_algorithm_t content_hash() const
+    {
+        return header_->flags & RSX_XXH64_KEYS ? hash_algorithm_t::xxh64 : hash_algorithm_t::md5;
+    }
+
+    std::span<const rsx_image_t> images() const { return records<rsx_image_t>(header_->images); }
+    std::span<const rsx_partition_t> partitions() const { return records<rsx_partition_t>(header_->partitions); }
+    std::span<const rsx_folder_t> folders() const { return records<rsx_folder_t>(header_->folders); }
+    std::span<const rsx_file_t> files() const { return records<rsx_file_t>(header_->files); }
+    std::span<const rsx_trigram_t> trigrams() const { return records<rsx_trigram_t>(header_->trigrams); }
+    std::span<const uint32_t> postings() const { return records<uint32_t>(header_->postings); }
+    std::span<const rsx_code_t> types() const { return records<rsx_code_t>(header_->types); }
+    std::span<const rsx_code_t> creators() const { return records<rsx_code_t>(header_->creators); }
+    std::span<const rsx_container_t> containers() const { return records<rsx_container_t>(header_->containers); }
+    std::span<const uint64_t> container_words() const { return records<uint64_t>(header_->container_words); }
+
+    /**
+     * Get the files of a type or creator.
+     * @param code A code of types() or creators()
+     * @return Its bitmap
+     */
+    code_bitmap_t files(const rsx_code_t &code) const
+    {
+        return {containers().subspan(code.first_container, code.container_count), container_words().data()};
+    }
+
+    /**
+     * Get the files of a type.
+     * @param type The type (see rsx_code)
+     * @return Its bitmap, empty if no file has the type
+     */
+    code_bitmap_t type_files(uint32_t type) const { return code_files(types(), type); }
+
+    /**
+     * Get the files of a creator.
+     * @param creator The creator (see rsx_code)
+     * @return Its bitmap, empty if no file has the creator
+     */
+    code_bitmap_t creator_files(uint32_t creator) const { return code_files(creators(), creator); }
+
+    /**
+     * Get the files and folders whose folded name contains a trigram.
+     * @param trigram The trigram (see rsx_trigram)
+     * @return The sorted entries, empty if no name contains the trigram
+     */
+    std::span<const uint32_t> postings(uint32_t trigram) const;
+
+    /**
+     * Find the files whose name matches a pattern, like name_filter_t.
+     * @param pattern A substring or glob pattern (see matches_name_pattern)
+     * @return Indexes of the matching files, sorted
+     */
+    std::vector<uint32_t> find_files(const std::string &pattern) const;
+
+    /**
+     * Find the folders whose name matches a pattern.
+     * @param pattern A substring or glob pattern (see matches_name_pattern)
+     * @return Indexes of the matching folders, sorted
+     */
+    std::vector<uint32_t> find_folders(const std::string &pattern) const;
+
+    /**
+     * Get the partition of a folder.
+     * @param folder Index of the folder
+     * @return Index of the partition
+     * @throws std::runtime_error if no partition holds the folder
+     */
+    uint32_t folder_partition(uint32_t folder) const;
+
+    /**
+     * Get a string of the pool.
+     * @param offset Offset of the string in the pool
+     * @return The string, empty for RSX_NONE
+     * @throws std::runtime_error if the string is outside of the pool
+     */
+    std::string_view string(uint32_t offset) const;
+
+    /**
+     * Get the path of a folder, from the root folder of its partition (ie: "Disk:Folder").
+     * @param folder Index of the folder
+     * @return The colon separated folder names
+     */
+    std::string folder_path(uint32_t folder) const;
+};
@@ -0,0 +1,370 @@
+#include "index/collection_writer.h"
+#include "index/collection_index.h"
+#include "file/file.h"
+#include "file/folder.h"
+#include "file/disk.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <stdexcept>
+#include <sys/stat.h>
+#include "utils/md5.h"
+
+void stat_image(const std::filesystem::path &path, rsx_image_t &image)
+{
+    struct stat st;
+    if (::stat(path.c_str(), &st) != 0)
+    {
+        throw std::runtime_error("Cannot stat file: " + path.string());
+    }
+    image.size = static_cast<uint64_t>(st.st_size);
+    image.mtime = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+    image.inode = static_cast<uint64_t>(st.st_ino);
+}
+
+void hash_image_header(datasource_t &source, rsx_image_t &image)
+{
+    auto block = source.read_block(0, std::min(source.size(), RSX_HEADER_HASH_SIZE));
+    MD5 md5;
+    md5.update(static_cast<const uint8_t *>(block.data()), block.size());
+    std::memcpy(image.header_hash, md5.getDigest(), sizeof(image.header_hash));
+}
+
+bool same_image_stat(const rsx_image_t &indexed, const rsx_image_t &current)
+{
+    return indexed.size == current.size && indexed.mtime == current.mtime && indexed.inode == current.inode;
+}
+
+uint32_t collection_writer_t::intern(const std::string &string)
+{
+    auto it = string_offsets_.find(string);
+    if (it != string_offsets_.end())
+    {
+        return it->second;
+    }
+
+    if (strings_.size() + sizeof(uint32_t) + string.size() >= RSX_NONE)
+    {
+        throw std::runtime_error("Index string pool is full");
+    }
+
+    uint32_t offset = static_cast<uint32_t>(strings_.size());
+    uint32_t length = static_cast<uint32_t>(string.size());
+    strings_.append(reinterpret_cast<const char *>(&length), sizeof(length));
+    strings_.append(string);
+    string_offsets_.emplace(string, offset);
+    return offset;
+}
+
+uint32_t collection_writer_t::intern(const collection_index_t &index, uint32_t offset)
+{
+    return offset == RSX_NONE ? RSX_NONE : intern(std::string(index.string(offset)));
+}
+
+void collection_writer_t::add_image(const std::filesystem::path &path, const rsx_image_t &signature)
+{
+    rsx_image_t image = signature;
+    image.path = intern(path.string());
+    image.first_partition = static_cast<uint32_t>(partitions_.size());
+    image.partition_count = 0;
+    image.flags = 0;
+    images_.push_back(image);
+}
+
+void collection_writer_t::add_deleted_image(const std::filesystem::path &path, const rsx_image_t &signature)
+{
+    add_image(path, signature);
+    images_.back().flags = RSX_IMAGE_DELETED;
+}
+
+void collection_writer_t::copy_image(const collection_index_t &index, uint32_t image_index, const rsx_image_t &signature)
+{
+    const auto &image = index.images()[image_index];
+    add_image(std::string(index.string(image.path)), signature);
+
+    for (uint32_t p = image.first_partition; p != image.first_partition + image.partition_count; p++)
+    {
+        const auto &partition = index.partitions()[p];
+        add_partition();
+        auto &copy = partitions_.back();
+        copy.disk_name = intern(index, partition.disk_name);
+        copy.disk_path = intern(index, partition.disk_path);
+
+        //  Folders and files refer to the folders of their partition, which keep their order
+        uint32_t first_folder = static_cast<uint32_t>(folders_.size());
+        auto copy_folder = [&](uint32_t folder)
+        {
+            if (folder == RSX_NONE)
+            {
+                return RSX_NONE;
+            }
+            if (folder - partition.first_folder >= partition.folder_count)
+            {
+                throw std::runtime_error("Corrupted index: folder outside of its partition");
+            }
+            return folder - partition.first_folder + first_folder;
+        };
+
+        for (const auto &folder : index.folders().subspan(partition.first_folder, partition.folder_count))
+        {
+            folders_.push_back({intern(index, folder.name), copy_folder(folder.parent), intern(index, folder.folded_name), 0});
+        }
+        copy.folder_count = partition.folder_count;
+
+        for (const auto &file : index.files().subspan(partition.first_file, partition.file_count))
+        {
+            rsx_file_t record = file;
+            record.name = intern(index, file.name);
+            record.folder = copy_folder(file.folder);
+            record.partition = static_cast<uint32_t>(partitions_.size() - 1);
+            record.content_key = content_keys_ ? intern(index, file.content_key) : RSX_NONE;
+            record.folded_name = intern(index, file.folded_name);
+            files_.push_back(record);
+        }
+        copy.file_count = partition.file_count;
+    }
+}
+
+void collection_writer_t::add_partition()
+{
+    if (images_.empty())
+    {
+        throw std::runtime_error("Index partition added before its image");
+    }
+
+    rsx_partition_t partition{};
+    partition.image = static_cast<uint32_t>(images_.size() - 1);
+    partition.disk_name = RSX_NONE;
+    partition.disk_path = RSX_NONE;
+    partition.first_folder = static_cast<uint32_t>(folders_.size());
+    partition.first_file = static_cast<uint32_t>(files_.size());
+    partitions_.push_back(partition);
+    images_.back().partition_count++;
+    folder_stack_.clear(); // The visit of the previous partition may have stopped on an error
+}
+
+bool collection_writer_t::pre_visit_folder(std::shared_ptr<Folder> folder)
+{
+    if (partitions_.empty())
+    {
+        throw std::runtime_error("Index folder visited before its partition");
+    }
+
+    rsx_folder_t record{};
+    record.name = intern(std::string(folder->name()));
+    record.parent = folder_stack_.empty() ? RSX_NONE : folder_stack_.back();
+    record.folded_name = intern(fold_case(std::string(folder->name())));
+    folder_stack_.push_back(static_cast<uint32_t>(folders_.size()));
+    folders_.push_back(record);
+    partitions_.back().folder_count++;
+    return true;
+}
+
+void collection_writer_t::post_visit_folder(std::shared_ptr<Folder>)
+{
+    folder_stack_.pop_back();
+}
+
+void collection_writer_t::visit_file(std::shared_ptr<File> file)
+{
+    auto &partition = partitions_.back();
+    if (partition.disk_name == RSX_NONE && file->disk())
+    {
+        partition.disk_name = intern(file->disk()->name());
+        partition.disk_path = intern(file->disk()->path());
+    }
+
+    rsx_file_t record{};
+    record.name = intern(std::string(file->original_name()));
+    record.folder = folder_stack_.empty() ? RSX_NONE : folder_stack_.back();
+    record.partition = static_cast<uint32_t>(partitions_.size() - 1);
+    record.type = file->type_code();
+    record.creator = file->creator_code();
+    record.data_size = file->data_size();
+    record.rsrc_size = file->rsrc_size();
+    record.content_key = content_keys_ ? intern(file->content_key()) : RSX_NONE;
+    record.folded_name = intern(fold_case(std::string(file->name())));
+    files_.push_back(record);
+    partition.file_count++;
+}
+
+//  Writes the records of a section, padded to 8 bytes, and fills its header entry
+template <typename T>
+static void write_section(std::ofstream &out, rsx_section_t &section, const T *data, size_t count)
+{
+    section.offset = static_cast<uint64_t>(out.tellp());
+    section.count = count;
+    out.write(reinterpret_cast<const char *>(data), count * sizeof(T));
+
+    static const char padding[8] = {};
+    out.write(padding, (8 - count * sizeof(T) % 8) % 8);
+}
+
+std::string_view collection_writer_t::pooled(uint32_t offset) const
+{
+    uint32_t length;
+    std::memcpy(&length, strings_.data() + offset, sizeof(length));
+    return std::string_view(strings_).substr(offset + sizeof(length), length);
+}
+
+void collection_writer_t::build_postings(std::vector<rsx_trigram_t> &trigrams, std::vector<uint32_t> &postings) const
+{
+    if (files_.size() + folders_.size() >= RSX_NONE)
+    {
+        throw std::runtime_error("Too many files and folders in index");
+    }
+
+    //  Entries are added in increasing order, so each list is sorted
+    std::unordered_map<uint32_t, std::vector<uint32_t>> lists;
+    std::vector<uint32_t> name_trigrams;
+    auto add_entry = [&](uint32_t entry, uint32_t folded_name)
+    {
+        auto name = pooled(folded_name);
+        name_trigrams.clear();
+        for (size_t i = 0; i + 3 <= name.size(); i++)
+        {
+            name_trigrams.push_back(rsx_trigram(name.data() + i));
+        }
+        std::sort(name_trigrams.begin(), name_trigrams.end());
+        name_trigrams.erase(std::unique(name_trigrams.begin(), name_trigrams.end()), name_trigrams.end());
+        for (auto trigram : name_trigrams)
+        {
+            lists[trigram].push_back(entry);
+        }
+    };
+    for (size_t i = 0; i != files_.size(); i++)
+    {
+        add_entry(static_cast<uint32_t>(i), files_[i].folded_name);
+    }
+    for (size_t i = 0; i != folders_.size(); i++)
+    {
+        add_entry(static_cast<uint32_t>(files_.size() + i), folders_[i].folded_name);
+    }
+
+    trigrams.clear();
+    trigrams.reserve(lists.size());
+    for (const auto &[trigram, list] : lists)
+    {
+        trigrams.push_back({trigram, static_cast<uint32_t>(list.size()), 0});
+    }
+    std::sort(trigrams.begin(), trigrams.end(), [](const auto &a, const auto &b)
+              { return a.trigram < b.trigram; });
+
+    postings.clear();
+    for (auto &trigram : trigrams)
+    {
+        const auto &list = lists[trigram.trigram];
+        trigram.first = postings.size();
+        postings.insert(postings.end(), list.begin(), list.end());
+    }
+}
+
+void collection_writer_t::build_code_bitmaps(uint32_t rsx_file_t::*field, std::vector<rsx_code_t> &codes,
+                                             std::vector<rsx_container_t> &containers, std::vector<uint64_t> &words) const
+{
+    //  Files are added in increasing order, so each list is sorted
+    std::map<uint32_t, std::vector<uint32_t>> lists;
+    for (size_t i = 0; i != files_.size(); i++)
+    {
+        lists[files_[i].*field].push_back(static_cast<uint32_t>(i));
+    }
+
+    codes.clear();
+    for (const auto &[code, list] : lists)
+    {
+        rsx_code_t entry{code, static_cast<uint32_t>(list.size()), static_cast<uint32_t>(containers.size()), 0};
+        for (size_t i = 0; i != list.size();)
+        {
+            //  The files of the chunk of list[i]
+            uint16_t key = static_cast<uint16_t>(list[i] >> 16);
+            size_t end = i;
+            while (end != list.size() && (list[end] >> 16) == key)
+            {
+                end++;
+            }
+
+            rsx_container_t container{key, 0, static_cast<uint32_t>(end - i), words.size()};
+            if (container.count > RSX_ARRAY_CONTAINER_MAX)
+            {
+                words.resize(words.size() + RSX_CHUNK_WORDS);
+                for (size_t j = i; j != end; j++)
+                {
+                    uint16_t low = static_cast<uint16_t>(list[j]);
+                    words[container.first + low / 64] |= uint64_t(1) << (low % 64);
+                }
+            }
+            else
+            {
+                words.resize(words.size() + (container.count + 3) / 4);
+                auto array = reinterpret_cast<char *>(words.data() + container.first);
+                for (size_t j = i; j != end; j++)
+                {
+                    uint16_t low = static_cast<uint16_t>(list[j]);
+                    std::memcpy(array + (j - i) * sizeof(low), &low, sizeof(low));
+                }
+            }
+            containers.push_back(container);
+            entry.container_count++;
+            i = end;
+        }
+        codes.push_back(entry);
+    }
+}
+
+void collection_writer_t::write(const std::filesystem::path &path) const
+{
+    std::vector<rsx_trigram_t> trigrams;
+    std::vector<uint32_t> postings;
+    build_postings(trigrams, postings);
+
+    std::vector<rsx_code_t> types;
+    std::vector<rsx_code_t> creators;
+    std::vector<rsx_container_t> containers;
+    std::vector<uint64_t> container_words;
+    build_code_bitmaps(&rsx_file_t::type, types, containers, container_words);
+    build_code_bitmaps(&rsx_file_t::creator, creators, containers, container_words);
+
+    auto temporary = path;
+    temporary += ".tmp";
+
+    std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+    if (!out)
+    {
+        throw std::runtime_error("Cannot create index file: " + temporary.string());
+    }
+
+    rsx_header_t header{};
+    std::memcpy(header.magic, RSX_MAGIC, sizeof(header.magic));
+    header.version = RSX_VERSION;
+    header.flags = content_keys_ ? RSX_CONTENT_KEYS : 0;
+    if (content_keys_ && gContentHash == hash_algorithm_t::xxh64)
+    {
+        header.flags |= RSX_XXH64_KEYS;
+    }
+
+    //  The header is written again once the sections are known
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    write_section(out, header.images, images_.data(), images_.size());
+    write_section(out, header.partitions, partitions_.data(), partitions_.size());
+    write_section(out, header.folders, folders_.data(), folders_.size());
+    write_section(out, header.files, files_.data(), files_.size());
+    write_section(out, header.strings, strings_.data(), strings_.size());
+    write_section(out, header.trigrams, trigrams.data(), trigrams.size());
+    write_section(out, header.postings, postings.data(), postings.size());
+    write_section(out, header.types, types.data(), types.size());
+    write_section(out, header.creators, creators.data(), creators.size());
+    write_section(out, header.containers, containers.data(), containers.size());
+    write_section(out, header.container_words, container_words.data(), container_words.size());
+    out.seekp(0);
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+    out.close();
+    if (!out)
+    {
+        throw std::runtime_error("Cannot write index file: " + temporary.string());
+    }
+    std::filesystem::rename(temporary, path);
+}
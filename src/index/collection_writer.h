@@ -0,0 +1,149 @@
+#pragma once
+
+#include "index/collection_format.h"
+#include "file/file_visitor.h"
+#include "data/data.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+class collection_index_t;
+
+/**
+ * Read the size, modification time and inode of an image file.
+ * @param path Path of the image file
+ * @param image Receives them
+ * @throws std::runtime_error if the file cannot be stat'ed
+ */
+void stat_image(const std::filesystem::path &path, rsx_image_t &image);
+
+/**
+ * Hash the start of an image file.
+ * @param source The image file
+ * @param image Receives the hash
+ */
+void hash_image_header(datasource_t &source, rsx_image_t &image);
+
+/**
+ * Check if an image file is unchanged since it was indexed.
+ * Only the stat fields are compared, hashes must be compared separately.
+ * @param indexed The image, as indexed
+ * @param current The image, as stat'ed now
+ * @return True if the size, modification time and inode are the same
+ */
+bool same_image_stat(const rsx_image_t &indexed, const rsx_image_t &current);
+
+/**
+ * Builds a collection index.
+ * The images and partitions are declared with add_image and add_partition,
+ * then the folders and files of each partition are recorded by visiting it.
+ * Images that did not change since a previous index are copied from it with copy_image.
+ */
+class collection_writer_t : public file_visitor_t
+{
+    bool content_keys_;
+
+    std::vector<rsx_image_t> images_;
+    std::vector<rsx_partition_t> partitions_;
+    std::vector<rsx_folder_t> folders_;
+    std::vector<rsx_file_t> files_;
+
+    std::string strings_;                                   // The string pool
+    std::unordered_map<std::string, uint32_t> string_offsets_; // String -> offset in the pool
+
+    std::vector<uint32_t> folder_stack_; // Folders being visited, innermost last
+
+    /**
+     * Add a string to the pool, unless it is already there.
+     * @param string The string
+     * @return Offset of the string in the pool
+     */
+    uint32_t intern(const std::string &string);
+
+    /**
+     * Add a string of another index to the pool.
+     * @param index The other index
+     * @param offset Offset of the string in the other index
+     * @return Offset of the string in the pool, RSX_NONE for RSX_NONE
+     */
+    uint32_t intern(const collection_index_t &index, uint32_t offset);
+
+    /**
+     * Get a string of the pool.
+     * @param offset Offset of the string in the pool
+     * @return The string
+     */
+    std::string_view pooled(uint32_t offset) const;
+
+    /**
+     * Build the inverted index of the folded names of the files and folders.
+     * @param trigrams Receives the trigrams, sorted
+     * @param postings Receives the postings of all trigrams
+     * @throws std::runtime_error if there are too many files and folders to number them
+     */
+    void build_postings(std::vector<rsx_trigram_t> &trigrams, std::vector<uint32_t> &postings) const;
+
+    /**
+     * Build the bitmaps of the files of each type or creator code.
+     * @param field The code of a file, &rsx_file_t::type or &rsx_file_t::creator
+     * @param codes Receives the codes, sorted
+     * @param containers Containers of the bitmaps, appended to
+     * @param words Words of the containers, appended to
+     */
+    void build_code_bitmaps(uint32_t rsx_file_t::*field, std::vector<rsx_code_t> &codes,
+                            std::vector<rsx_container_t> &containers, std::vector<uint64_t> &words) const;
+
+public:
+    /**
+     * Create an empty index.
+     * @param content_keys If true, the content key of each file is computed and stored
+     */
+    explicit collection_writer_t(bool content_keys) : content_keys_(content_keys) {}
+
+    /**
+     * Start a new disk image, the partitions added next belong to it.
+     * @param path Path of the image file
+     * @param signature Size, modification time, inode and header hash of the image file
+     */
+    void add_image(const std::filesystem::path &path, const rsx_image_t &signature);
+
+    /**
+     * Copy an image, with its partitions, folders and files, from another index.
+     * @param index The other index, which must have content keys if this one has
+     * @param image Index of the image in the other index
+     * @param signature Size, modification time, inode and header hash of the image file
+     * @throws std::runtime_error if the records of the image are inconsistent
+     */
+    void copy_image(const collection_index_t &index, uint32_t image, const rsx_image_t &signature);
+
+    /**
+     * Add the tombstone of an image.
+     * @param path Path of the image file
+     * @param signature Signature of the image file when it was last indexed
+     */
+    void add_deleted_image(const std::filesystem::path &path, const rsx_image_t &signature);
+
+    /**
+     * Start a new partition of the current image, the folders and files visited next belong to it.
+     */
+    void add_partition();
+
+    bool pre_visit_folder(std::shared_ptr<Folder> folder) override;
+    void post_visit_folder(std::shared_ptr<Folder> folder) override;
+    void visit_file(std::shared_ptr<File> file) override;
+
+    size_t image_count() const { return images_.size(); }
+    size_t file_count() const { return files_.size(); }
+
+    /**
+     * Write the index.
+     * The index is written next to its destination and renamed, so an existing index is replaced atomically.
+     * @param path Destination file
+     * @throws std::runtime_error if the file cannot be written
+     */
+    void write(const std::filesystem::path &path) const;
+};
@@ -0,0 +1,120 @@
+#include "index/file_selection.h"
+
+#include <algorithm>
+#include <bit>
+
+file_selection_t::file_selection_t(size_t size, bool all) : words_((size + 63) / 64, all ? ~uint64_t(0) : 0), size_(size)
+{
+    if (all && size % 64)
+    {
+        words_.back() = (uint64_t(1) << (size % 64)) - 1;
+    }
+}
+
+//  Sets the bits of the files of an array container in the words of its chunk
+static void chunk_from_array(std::span<const uint16_t> array, uint64_t *chunk)
+{
+    std::fill(chunk, chunk + RSX_CHUNK_WORDS, 0);
+    for (auto low : array)
+    {
+        chunk[low / 64] |= uint64_t(1) << (low % 64);
+    }
+}
+
+void file_selection_t::intersect(const code_bitmap_t &bitmap)
+{
+    uint64_t array_chunk[RSX_CHUNK_WORDS];
+
+    //  Chunks without a container have no file of the code
+    size_t cleared = 0;
+    for (const auto &container : bitmap.containers)
+    {
+        size_t first = size_t(container.key) * RSX_CHUNK_WORDS;
+        if (first >= words_.size())
+        {
+            break;
+        }
+        size_t end = std::min(first + RSX_CHUNK_WORDS, words_.size());
+        std::fill(words_.begin() + std::min(cleared, first), words_.begin() + first, 0);
+
+        const uint64_t *chunk = bitmap.words + container.first;
+        if (container.count <= RSX_ARRAY_CONTAINER_MAX)
+        {
+            chunk_from_array(bitmap.array(container), array_chunk);
+            chunk = array_chunk;
+        }
+        for (size_t i = first; i != end; i++)
+        {
+            words_[i] &= chunk[i - first];
+        }
+        cleared = end;
+    }
+    std::fill(words_.begin() + std::min(cleared, words_.size()), words_.end(), 0);
+}
+
+void file_selection_t::intersect(const std::vector<uint32_t> &files)
+{
+    std::vector<uint64_t> kept(words_.size(), 0);
+    for (auto file : files)
+    {
+        if (file < size_)
+        {
+            kept[file / 64] |= words_[file / 64] & (uint64_t(1) << (file % 64));
+        }
+    }
+    words_ = std::move(kept);
+}
+
+size_t file_selection_t::count() const
+{
+    size_t result = 0;
+    for (auto word : words_)
+    {
+        result += std::popcount(word);
+    }
+    return result;
+}
+
+size_t file_selection_t::count(const code_bitmap_t &bitmap) const
+{
+    size_t result = 0;
+    for (const auto &container : bitmap.containers)
+    {
+        size_t first = size_t(container.key) * RSX_CHUNK_WORDS;
+        if (first >= words_.size())
+        {
+            break;
+        }
+
+        if (container.count <= RSX_ARRAY_CONTAINER_MAX)
+        {
+            for (auto low : bitmap.array(container))
+            {
+                size_t word = first + low / 64;
+                result += word < words_.size() && (words_[word] >> (low % 64)) & 1;
+            }
+        }
+        else
+        {
+            size_t end = std::min(first + RSX_CHUNK_WORDS, words_.size());
+            for (size_t i = first; i != end; i++)
+            {
+                result += std::popcount(words_[i] & bitmap.words[container.first + i - first]);
+            }
+        }
+    }
+    return result;
+}
+
+std::vector<uint32_t> file_selection_t::files() const
+{
+    std::vector<uint32_t> result;
+    for (size_t i = 0; i != words_.size(); i++)
+    {
+        for (uint64_t word = words_[i]; word; word &= word - 1)
+        {
+            result.push_back(static_cast<uint32_t>(i * 64 + std::countr_zero(word)));
+        }
+    }
+    return result;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "index/collection_index.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * A set of files of a collection index, one bit per file.
+ * The files of the type, creator and name filters of a query are combined by intersecting it with their bitmaps.
+ */
+class file_selection_t
+{
+    std::vector<uint64_t> words_;
+    size_t size_; // Number of files of the index
+
+public:
+    /**
+     * Create a selection.
+     * @param size Number of files of the index
+     * @param all If true, all files are selected, otherwise none
+     */
+    file_selection_t(size_t size, bool all);
+
+    /**
+     * Keep only the files of a code.
+     * @param bitmap The files of the code
+     */
+    void intersect(const code_bitmap_t &bitmap);
+
+    /**
+     * Keep only some files.
+     * @param files Indexes of the files to keep, sorted
+     */
+    void intersect(const std::vector<uint32_t> &files);
+
+    /**
+     * Count the selected files.
+     * @return Number of files
+     */
+    size_t count() const;
+
+    /**
+     * Count the selected files of a code, without changing the selection.
+     * @param bitmap The files of the code
+     * @return Number of files both selected and of the code
+     */
+    size_t count(const code_bitmap_t &bitmap) const;
+
+    /**
+     * Get the selected files.
+     * @return Indexes of the files, sorted
+     */
+    std::vector<uint32_t> files() const;
+};
@@ -0,0 +1,44 @@
+#include "mfs/mfs_fork.h"
+#include "mfs/mfs_partition.h"
+#include <algorithm>
+
+mfs_fork_t::mfs_fork_t(const mfs_partition_t &partition, uint16_t start_block, uint32_t logical_size)
+    : partition_(partition), start_block_(start_block), logical_size_(logical_size) {}
+
+uint32_t mfs_fork_t::size() const
+{
+    return logical_size_;
+}
+
+std::vector<uint8_t> mfs_fork_t::read(uint32_t offset, uint32_t size)
+{
+    // Handle out-of-bounds offset
+    if (offset >= logical_size_) {
+        return {};
+    }
+
+    // Clamp size to not read beyond end of content
+    size = std::min(size, logical_size_ - offset);
+
+    if (runs_.empty()) {
+        runs_ = partition_.fork_runs(start_block_, logical_size_);
+    }
+
+    std::vector<uint8_t> result(size);
+    uint8_t *destination = result.data();
+
+    // Copy the part of each run that overlaps the requested range
+    uint32_t run_position = 0;
+    for (const auto &run : runs_) {
+        uint32_t run_end = run_position + run.length;
+        if (run_end > offset && run_position < offset + size) {
+            uint32_t start = std::max(offset, run_position);
+            uint32_t end = std::min(offset + size, run_end);
+            partition_.datasource().read_into(run.offset + (start - run_position), end - start, destination);
+            destination += end - start;
+        }
+        run_position = run_end;
+    }
+
+    return result;
+}
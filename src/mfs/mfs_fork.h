@@ -3,33 +3,48 @@
 #include "fork.h"
 #include <vector>
 #include <cstdint>
-#include <algorithm>
+#include <memory>
+
+// Forward declarations
+class mfs_partition_t;
 
 /**
- * MFS implementation of fork_t that stores fork content in memory.
- * This implementation uses eager loading - the entire fork content is
- * read and stored when the object is created.
+ * MFS implementation of fork_t interface.
+ * The content is read on demand, by following the chain of allocation blocks
+ * of the fork in the volume block map, so fragmented files are read correctly.
  */
 class mfs_fork_t : public fork_t
 {
-    std::vector<uint8_t> content_;
+public:
+    /**
+     * Contiguous part of a fork on disk.
+     */
+    struct run_t
+    {
+        uint64_t offset; ///< Offset in the volume, in bytes
+        uint32_t length; ///< Length in bytes
+    };
+
+private:
+    const mfs_partition_t &partition_; // Kept alive by the arena of the fork
+    uint16_t start_block_;
+    uint32_t logical_size_;
+    std::vector<run_t> runs_; // Resolved from the block map on the first read
 
 public:
     /**
-     * Create an MFS file fork with the given content.
-     * @param content The complete fork content (moved into this object)
+     * Construct an MFS fork.
+     * @param partition Partition containing the fork, must outlive the fork
+     * @param start_block First allocation block of the fork
+     * @param logical_size Logical size of the fork in bytes
      */
-    explicit mfs_fork_t(std::vector<uint8_t> content)
-        : content_(std::move(content)) {}
+    mfs_fork_t(const mfs_partition_t &partition, uint16_t start_block, uint32_t logical_size);
 
     /**
      * Get the size of this fork.
-     * @return The number of bytes in the fork content
+     * @return Size in bytes
      */
-    uint32_t size() const override
-    {
-        return static_cast<uint32_t>(content_.size());
-    }
+    uint32_t size() const override;
 
     /**
      * Read data from this fork.
@@ -37,17 +52,5 @@ public:
      * @param size Maximum number of bytes to read
      * @return Vector containing the requested data (properly bounds-checked)
      */
-    std::vector<uint8_t> read(uint32_t offset, uint32_t size) override
-    {
-        // Handle out-of-bounds offset
-        if (offset >= content_.size()) {
-            return {};
-        }
-
-        // Clamp size to not read beyond end of content
-        size = std::min(size, static_cast<uint32_t>(content_.size()) - offset);
-
-        // Return slice of content vector
-        return {content_.begin() + offset, content_.begin() + offset + size};
-    }
-};
\ No newline at end of file
+    std::vector<uint8_t> read(uint32_t offset, uint32_t size) override;
+};
@@ -1,9 +1,43 @@
 #include "mfs_partition.h"
 
 // mfs_partition_t implementation
+//  The block map follows the 64 bytes of the Master Directory Block
+static const uint64_t MFS_MDB_OFFSET = 1024;
+static const uint64_t MFS_BLOCK_MAP_OFFSET = MFS_MDB_OFFSET + 64;
+
 mfs_partition_t::mfs_partition_t(std::shared_ptr<datasource_t> source)
-    : source_(source), root_folder_(nullptr)
+    : source_(source)
 {
+    block_t mdb_block = source_->read_block(MFS_MDB_OFFSET, 512);
+    const MFSMasterDirectoryBlock *mdb = static_cast<const MFSMasterDirectoryBlock *>(mdb_block.data());
+
+    volume_name_ = from_macroman(string_from_pstring(mdb->drVN));
+    dir_start_ = be16(mdb->drDirSt);
+    dir_length_ = be16(mdb->drBlLen);
+    alloc_block_size_ = be32(mdb->drAlBlkSiz);
+
+    // From MFS spec: "Like FAT, allocation blocks are numbered starting from 2.
+    // However, unlike FAT, the block map begins with allocation block 2 instead
+    // of skipping the first two entries."
+    alloc_area_start_ = static_cast<uint64_t>(be16(mdb->drAlBlSt)) * 512;
+
+    // The block map has one 12 bits entry per allocation block
+    uint16_t block_count = be16(mdb->drNmAlBlks);
+    uint64_t map_size = (static_cast<uint64_t>(block_count) * 3 + 1) / 2;
+    if (MFS_BLOCK_MAP_OFFSET + map_size > source_->size())
+    {
+        throw std::runtime_error("MFS block map beyond the end of the volume");
+    }
+
+    block_t map_block = source_->read_block(MFS_BLOCK_MAP_OFFSET, map_size);
+    const uint8_t *map = static_cast<const uint8_t *>(map_block.data());
+
+    block_map_.resize(block_count);
+    for (uint16_t i = 0; i != block_count; i++)
+    {
+        const uint8_t *entry = map + i * 3 / 2;
+        block_map_[i] = (i & 1) ? ((entry[0] & 0x0F) << 8) | entry[1] : (entry[0] << 4) | (entry[1] >> 4);
+    }
 }
 
 bool mfs_partition_t::is_mfs(std::shared_ptr<datasource_t> source)
@@ -22,83 +56,60 @@ bool mfs_partition_t::is_mfs(std::shared_ptr<datasource_t> source)
     return be16(mdb->drSigWord) == 0xD2D7;
 }
 
-std::vector<uint8_t> mfs_partition_t::read_file_fork(const MFSDirectoryEntry *entry, bool is_resource_fork) const
+std::vector<mfs_fork_t::run_t> mfs_partition_t::fork_runs(uint16_t start_block, uint32_t size) const
 {
-    // Get the starting block and length for the appropriate fork
-    uint16_t start_block = is_resource_fork ? be16(entry->deRsrcABlk) : be16(entry->deDataABlk);
-    uint32_t fork_size = is_resource_fork ? be32(entry->deRsrcLen) : be32(entry->deDataLen);
-    
-    if (fork_size == 0) {
-        return {};  // Empty fork
-    }
-    
-    // We need to read the MDB again to get allocation block size
-    block_t mdb_block = source_->read_block(1024, 512);
-    const MFSMasterDirectoryBlock *mdb = static_cast<const MFSMasterDirectoryBlock *>(mdb_block.data());
-    
-    uint32_t alloc_block_size = be32(mdb->drAlBlkSiz);
-    uint16_t first_alloc_block = be16(mdb->drAlBlSt);
+    std::vector<mfs_fork_t::run_t> runs;
+    uint16_t block = start_block;
+    uint32_t remaining = size;
 
-    // Calculate the actual disk offset
-    // From MFS spec: "Like FAT, allocation blocks are numbered starting from 2. 
-    // However, unlike FAT, the block map begins with allocation block 2 instead 
-    // of skipping the first two entries."
-    // This means allocation block numbers in directory entries start from 2
-    uint32_t alloc_area_start = first_alloc_block * 512;
-    
-    // Subtract 2 because allocation blocks are numbered starting from 2
-    uint32_t adjusted_alloc_block = (start_block >= 2) ? start_block - 2 : 0;
-    uint32_t start_offset = alloc_area_start + (adjusted_alloc_block * alloc_block_size);
-    
-    // Read the fork content
-    block_t fork_block = source_->read_block(start_offset, fork_size);
-    const uint8_t* fork_data = static_cast<const uint8_t*>(fork_block.data());
-    
-    return std::vector<uint8_t>(fork_data, fork_data + fork_size);
-}
+    // A valid chain cannot be longer than the block map
+    for (size_t count = 0; remaining > 0; count++)
+    {
+        if (block < 2 || block - 2u >= block_map_.size() || count == block_map_.size())
+        {
+            throw std::runtime_error(std::format("Invalid MFS allocation block {} in fork starting at block {}", block, start_block));
+        }
 
-std::pair<std::vector<uint8_t>, std::vector<uint8_t>> mfs_partition_t::read_file_content(const MFSDirectoryEntry *entry) const
-{
-    auto data_fork = read_file_fork(entry, false);   // Data fork
-    auto rsrc_fork = read_file_fork(entry, true);    // Resource fork
-    
-    return {std::move(data_fork), std::move(rsrc_fork)};
-}
+        uint64_t offset = alloc_area_start_ + static_cast<uint64_t>(block - 2) * alloc_block_size_;
+        uint32_t length = std::min(remaining, alloc_block_size_);
 
-void mfs_partition_t::build_root_folder()
-{
-    ENTRY("");
+        if (!runs.empty() && runs.back().offset + runs.back().length == offset)
+        {
+            runs.back().length += length;
+        }
+        else
+        {
+            runs.push_back({offset, length});
+        }
+        remaining -= length;
 
-    // Return early if already built
-    if (root_folder_) {
-        return;
+        block = block_map_[block - 2];
     }
 
-    // Read the Master Directory Block at offset 1024
-    block_t mdb_block = source_->read_block(1024, 512);
-    const MFSMasterDirectoryBlock *mdb = static_cast<const MFSMasterDirectoryBlock *>(mdb_block.data());
-
-    // Extract directory information
-    uint16_t dir_start = be16(mdb->drDirSt);
-    uint16_t dir_length = be16(mdb->drBlLen);
+    return runs;
+}
 
-    // Get volume name from MDB
-    std::string volume_name = string_from_pstring(mdb->drVN);
-    volume_name = from_macroman(volume_name);
+std::shared_ptr<Folder> mfs_partition_t::build_root_folder()
+{
+    ENTRY("");
 
     // Create disk and root folder
-    auto disk = std::make_shared<Disk>(volume_name, source_->description());
-    root_folder_ = std::make_shared<Folder>(volume_name);
+    // The folder, its files and their forks are all allocated from one arena, released with the last of them
+    // The forks read through the partition, which the arena keeps alive
+    auto disk = std::make_shared<Disk>(volume_name_, source_->description(), source_->fingerprint());
+    auto arena = std::make_shared<object_arena_t>();
+    arena->make<std::shared_ptr<const mfs_partition_t>>(shared_from_this());
+    auto root = arena->make<Folder>(*disk, volume_name_, arena->resource());
 
     // Calculate directory offset (dir_start is in 512-byte blocks)
-    uint32_t dir_offset = dir_start * 512;
+    uint32_t dir_offset = dir_start_ * 512;
 
     // Parse directory block by block (512 bytes each)
     size_t entries_found = 0;
     
-    rs_log("Scanning MFS directory: {} files, dir_start={}, dir_length={}", be16(mdb->drNmFls), dir_start, dir_length);
+    rs_log("Scanning MFS directory: dir_start={}, dir_length={}", dir_start_, dir_length_);
     
-    for (uint16_t block_num = 0; block_num < dir_length; block_num++) {
+    for (uint16_t block_num = 0; block_num < dir_length_; block_num++) {
         uint32_t block_offset = dir_offset + (block_num * 512);
         block_t dir_block = source_->read_block(block_offset, 512);
         const uint8_t *block_data = static_cast<const uint8_t *>(dir_block.data());
@@ -153,26 +164,23 @@ void mfs_partition_t::build_root_folder()
                 rs_log("  Type: {}, Creator: {}, Data: {} bytes, Resource: {} bytes",
                        type, creator, data_size, rsrc_size);
 
-                // Read the actual file content
-                auto [data_content, rsrc_content] = read_file_content(entry);
-
-                // Create File with forks
-                std::unique_ptr<fork_t> data_fork;
-                std::unique_ptr<fork_t> rsrc_fork;
+                // Create File with forks, their content is read on demand
+                fork_t *data_fork = nullptr;
+                fork_t *rsrc_fork = nullptr;
                 
-                if (!data_content.empty()) {
-                    data_fork = std::make_unique<mfs_fork_t>(std::move(data_content));
+                if (data_size > 0) {
+                    data_fork = arena->make<mfs_fork_t>(*this, be16(entry->deDataABlk), data_size);
                 }
-                if (!rsrc_content.empty()) {
-                    rsrc_fork = std::make_unique<mfs_fork_t>(std::move(rsrc_content));
+                if (rsrc_size > 0) {
+                    rsrc_fork = arena->make<mfs_fork_t>(*this, be16(entry->deRsrcABlk), rsrc_size);
                 }
 
                 // Create File object
-                auto file = std::make_shared<File>(disk, filename, type, creator,
-                                                          std::move(data_fork), std::move(rsrc_fork));
+                auto file = arena->make<File>(disk, filename, be32(entry->deType), be32(entry->deCreator), be32(entry->deFileNum),
+                                              data_fork, rsrc_fork);
 
                 // Add file to root folder
-                root_folder_->add_file(file);
+                root->add_file(file);
                 entries_found++;
             }
             
@@ -182,12 +190,21 @@ void mfs_partition_t::build_root_folder()
     }
 
     rs_log("Found {} files in use", entries_found);
+
+    return object_arena_t::handle(arena, root);
+}
+
+void mfs_partition_t::prefetch()
+{
+    source_->prefetch(dir_start_ * 512, dir_length_ * 512);
 }
 
 std::shared_ptr<Folder> mfs_partition_t::get_root_folder()
 {
-    if (!root_folder_) {
-        build_root_folder();
+    auto root = root_folder_.lock();
+    if (!root) {
+        root = build_root_folder();
+        root_folder_ = root;
     }
-    return root_folder_;
+    return root;
 }
\ No newline at end of file
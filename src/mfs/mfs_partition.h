@@ -24,6 +24,7 @@
 #include "data/data.h"
 #include "partition.h"
 #include "mfs/mfs_fork.h"
+#include "utils/object_arena.h"
 
 // Forward declarations
 class mfs_partition_t;
@@ -40,36 +41,35 @@ bool is_mfs(std::shared_ptr<datasource_t> source);
  * Provides access to files and folders in classic Mac MFS volumes.
  * MFS is the original flat filesystem used by early Macintosh systems.
  */
-class mfs_partition_t : public partition_t
+class mfs_partition_t : public partition_t, public std::enable_shared_from_this<mfs_partition_t>
 {
 private:
     std::shared_ptr<datasource_t> source_;
-    std::shared_ptr<Folder> root_folder_;  // Cached root folder
-    
-    /**
-     * Read data from a specific fork of an MFS file.
-     * @param entry MFS directory entry for the file
-     * @param is_resource_fork True to read resource fork, false for data fork
-     * @return Vector containing the fork data
-     */
-    std::vector<uint8_t> read_file_fork(const MFSDirectoryEntry *entry, bool is_resource_fork) const;
-    
-    /**
-     * Read both data and resource forks of an MFS file.
-     * @param entry MFS directory entry for the file
-     * @return Pair of vectors: first=data fork, second=resource fork
-     */
-    std::pair<std::vector<uint8_t>, std::vector<uint8_t>> read_file_content(const MFSDirectoryEntry *entry) const;
-    
+    std::weak_ptr<Folder> root_folder_;    // Cached root folder, weak as the hierarchy keeps the partition alive
+
+    // Parsed once from the Master Directory Block
+    std::string volume_name_;
+    uint16_t dir_start_ = 0;               // First block of the directory
+    uint16_t dir_length_ = 0;              // Length of the directory in blocks
+    uint32_t alloc_block_size_ = 0;        // Size of allocation blocks in bytes
+    uint64_t alloc_area_start_ = 0;        // Offset of allocation block 2, in bytes
+
+    // Volume block map: for each allocation block, starting with block 2,
+    // the next block of the same fork, 1 for the last block of a fork, 0 if free
+    std::vector<uint16_t> block_map_;
+
     /**
      * Build the root folder structure by parsing the MFS directory.
      * Creates File objects for all entries in the MFS directory.
+     * Fork contents are not read.
+     * @return The root folder, which keeps the partition alive
      */
-    void build_root_folder();
+    std::shared_ptr<Folder> build_root_folder();
 
 public:
     /**
      * Construct MFS partition from a data source.
+     * Reads the Master Directory Block and the volume block map.
      * @param source Data source containing the MFS volume data
      */
     explicit mfs_partition_t(std::shared_ptr<datasource_t> source);
@@ -79,6 +79,11 @@ public:
      * @return Shared pointer to the root folder containing all files
      */
     std::shared_ptr<Folder> get_root_folder() override;
+
+    /**
+     * Prefetch the file directory.
+     */
+    void prefetch() override;
     
     /**
      * Check if a data source contains an MFS partition.
@@ -86,4 +91,20 @@ public:
      * @return True if the source appears to contain a valid MFS filesystem
      */
     static bool is_mfs(std::shared_ptr<datasource_t> source);
+
+    /**
+     * Get the underlying data source.
+     * @return Reference to the data source
+     */
+    datasource_t &datasource() const { return *source_; }
+
+    /**
+     * Follow the block map to find where the content of a fork is on disk.
+     * Adjacent allocation blocks are merged into a single run.
+     * @param start_block First allocation block of the fork
+     * @param size Logical size of the fork in bytes
+     * @return The runs covering the fork, in fork order
+     * @throws std::runtime_error if the chain of blocks is shorter than the fork or is invalid
+     */
+    std::vector<mfs_fork_t::run_t> fork_runs(uint16_t start_block, uint32_t size) const;
 };
\ No newline at end of file
@@ -1,19 +1,26 @@
 #include "partition.h"
+#include "file/folder.h"
 #include "hfs/hfs_partition.h"
 #include "mfs/mfs_partition.h"
+#include "data/cached_datasource.h"
 #include "utils.h"
 
+#include <algorithm>
+
 std::shared_ptr<partition_t> partition_t::create(std::shared_ptr<datasource_t> source)
 {
     ENTRY("");
 
+    // All metadata reads of the partition (detection, MDB, B-trees) go through a shared cache
+    if (gCacheSize > 0)
+    {
+        source = std::make_shared<cached_datasource_t>(source, gCacheSize, gCachePageSize);
+    }
+
     // Try HFS first
     if (is_hfs(source)) {
         rs_log("Creating HFS partition");
-        auto partition = std::make_shared<hfs_partition_t>(source);
-        // Now that we have a shared_ptr, we can build the files
-        std::static_pointer_cast<hfs_partition_t>(partition)->complete_initialization();
-        return partition;
+        return std::make_shared<hfs_partition_t>(source);
     }
 
     // Try MFS
@@ -34,4 +41,31 @@ bool partition_t::is_hfs(std::shared_ptr<datasource_t> source)
 bool partition_t::is_mfs(std::shared_ptr<datasource_t> source)
 {
     return mfs_partition_t::is_mfs(source);
-}
\ No newline at end of file
+}
+std::shared_ptr<File> partition_t::find_file(const std::string &path)
+{
+    auto components = split_string(path, ':');
+    auto root = get_root_folder();
+    if (components.size() < 2 || !root || !equals_case_insensitive(root->name(), components[0]))
+    {
+        return nullptr;
+    }
+
+    Folder *folder = root.get();
+    for (size_t i = 1; folder && i + 1 < components.size(); i++)
+    {
+        auto next = std::find_if(folder->folders().begin(), folder->folders().end(), [&](const auto &child)
+                                 { return equals_case_insensitive(child->name(), components[i]); });
+        folder = next != folder->folders().end() ? *next : nullptr;
+    }
+
+    if (!folder)
+    {
+        return nullptr;
+    }
+
+    auto file = std::find_if(folder->files().begin(), folder->files().end(), [&](const auto &child)
+                             { return equals_case_insensitive(child->name(), components.back()); });
+    //  The file shares the ownership of the folders of the partition
+    return file != folder->files().end() ? std::shared_ptr<File>(root, *file) : nullptr;
+}
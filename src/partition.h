@@ -19,13 +19,42 @@ public:
 
     /**
      * Get the root folder of the partition.
+     * The folders, files and forks are allocated in one arena, that is released
+     * when no shared pointer to any of them is left (see Folder).
      * @return Shared pointer to the root folder
      */
     virtual std::shared_ptr<Folder> get_root_folder() = 0;
 
+    /**
+     * Get a root folder holding only the files accepted by a visitor.
+     * Partitions that can read file metadata before creating the File objects
+     * use file_visitor_t::accepts_file to skip the others.
+     * The default implementation returns the complete root folder.
+     * @param visitor The visitor that will visit the folder
+     * @return Shared pointer to the root folder
+     */
+    virtual std::shared_ptr<Folder> get_root_folder_for(file_visitor_t &) { return get_root_folder(); }
+
+    /**
+     * Hint the data source about the metadata that mounting the partition will read,
+     * so it can be fetched while other work is done.
+     * The default implementation does nothing.
+     */
+    virtual void prefetch() {}
+
+    /**
+     * Find a file from its path.
+     * The default implementation walks the folder hierarchy.
+     * @param path Colon separated path, starting with the volume name (ie: "Disk:Folder:File")
+     * @return The file, or nullptr if there is no file at that path
+     */
+    virtual std::shared_ptr<File> find_file(const std::string &path);
+
     /**
      * Factory method to create the appropriate partition type based on the data source.
      * Automatically detects whether the partition is MFS or HFS.
+     * The folder hierarchy is built on the first get_root_folder call, and is only
+     * cached by the partition while it is in use, as it keeps the partition alive.
      * @param source The data source to analyze
      * @return Shared pointer to the appropriate partition implementation, or nullptr if not recognized
      */
@@ -8,9 +8,20 @@
 #include "data/apm_datasource.h"
 #include "data/dc42_datasource.h"
 #include "data/bin_datasource.h"
+#include "data/mmap_datasource.h"
+#include "data/cached_datasource.h"
 #include "rsrc/rsrc.h"
 #include "rsrc/rsrc_parser.h"
 #include "utils/md5.h"
+#include "utils/work_pool.h"
+#include "utils/bounded_queue.h"
+#include "utils/hash_cache.h"
+#include "utils/hash_pool.h"
+#include "utils/hasher.h"
+#include "utils/md5_multi.h"
+#include "index/collection_writer.h"
+#include "index/collection_index.h"
+#include "index/file_selection.h"
 
 #include <cstdint>
 #include <string>
@@ -27,6 +38,13 @@
 #include <unordered_set>
 #include <cassert>
 #include <algorithm>
+#include <chrono>
+#include <atomic>
+#include <future>
+#include <exception>
+#include <thread>
+#include <iterator>
+#include <optional>
 
 std::string string_from_sizes(uint32_t min, uint32_t max)
 {
@@ -69,24 +87,34 @@ std::string string_from_file(const File &file)
                        string_from_fork_sizes(file.data_size(), file.rsrc_size()));
 }
 
-std::string string_from_path(const std::vector<std::shared_ptr<Folder>> &path_vector)
+//  A file of a collection index, as shown by query
+struct indexed_file_t
 {
-    if (path_vector.empty())
-    {
-        return "";
-    }
+    std::string name; // Sanitized, like File::name()
+    std::string type;
+    std::string creator;
+    uint32_t data_size;
+    uint32_t rsrc_size;
+};
 
-    //  Copy and reverse the path to get root:first
-    std::vector<std::shared_ptr<Folder>> reversed_path(path_vector.rbegin(), path_vector.rend());
+//  Same, for a file of a collection index
+std::string string_from_file(const indexed_file_t &metadata)
+{
+    return std::format("{} {}/{} {}",
+                       metadata.name, metadata.type, metadata.creator,
+                       string_from_fork_sizes(metadata.data_size, metadata.rsrc_size));
+}
 
+std::string string_from_path(const std::vector<Folder *> &path_vector)
+{
     std::string result;
-    for (size_t i = 0; i < reversed_path.size(); ++i)
+    for (size_t i = 0; i < path_vector.size(); ++i)
     {
         if (i > 0)
         {
             result += ":";
         }
-        result += reversed_path[i]->name();
+        result += path_vector[i]->name();
     }
     return result;
 }
@@ -142,6 +170,8 @@ public:
     virtual ~filter_t() = default;
     virtual bool matches(const File &) = 0;
     virtual bool matches(const Folder &) { return true; }
+    //  Checks the metadata read when mounting, before the File exists
+    virtual bool matches(const file_metadata_t &) { return true; }
 };
 
 class filter_visitor_t : public file_visitor_t
@@ -150,9 +180,25 @@ class filter_visitor_t : public file_visitor_t
     std::vector<std::shared_ptr<filter_t>> filters_;
 
 public:
-    filter_visitor_t(std::vector<std::shared_ptr<filter_t>> &filters, std::shared_ptr<file_visitor_t> next) : next_(next),
-                                                                                                              filters_(filters)
+    filter_visitor_t(const std::vector<std::shared_ptr<filter_t>> &filters, std::shared_ptr<file_visitor_t> next) : next_(next),
+                                                                                                                    filters_(filters)
+    {
+    }
+
+    //  Filters are stateless, so the forks share them
+    std::shared_ptr<file_visitor_t> fork() const override
+    {
+        auto next = next_->fork();
+        if (!next)
+        {
+            return nullptr;
+        }
+        return std::make_shared<filter_visitor_t>(filters_, next);
+    }
+
+    void merge(file_visitor_t &other) override
     {
+        next_->merge(*static_cast<filter_visitor_t &>(other).next_);
     }
 
     void visit_file(std::shared_ptr<File> file) override
@@ -173,6 +219,23 @@ public:
         next_->visit_file(file);
     }
 
+    bool accepts_file(const file_metadata_t &metadata) override
+    {
+        for (const auto &filter : filters_)
+        {
+            if (!filter->matches(metadata))
+            {
+                return false;
+            }
+        }
+        return next_->accepts_file(metadata);
+    }
+
+    bool has_file_filter() const override
+    {
+        return !filters_.empty() || next_->has_file_filter();
+    }
+
     bool pre_visit_folder(std::shared_ptr<Folder> folder) override
     {
         for (const auto &filter : filters_)
@@ -186,15 +249,22 @@ public:
     }
 };
 
+//  Matches names containing the pattern, or the whole name for a glob pattern (see matches_name_pattern)
+//  Case is folded like in a collection index, so both find the same files
 class name_filter_t : public filter_t
 {
-    std::string pattern_;
+    std::string pattern_; // Case folded
 
 public:
-    name_filter_t(const std::string &pattern) : pattern_(pattern) {}
+    name_filter_t(const std::string &pattern) : pattern_(fold_case(pattern)) {}
     bool matches(const File &file) override
     {
-        return has_case_insensitive_substring(file.name(), pattern_);
+        return matches_name_pattern(fold_case(std::string(file.name())), pattern_);
+    }
+    //  Folds the name as stored, without going through UTF-8
+    bool matches(const file_metadata_t &metadata) override
+    {
+        return matches_name_pattern(fold_macroman(sanitize_string(std::string(metadata.macroman_name))), pattern_);
     }
 };
 
@@ -208,6 +278,10 @@ public:
     {
         return file.type() == type_;
     }
+    bool matches(const file_metadata_t &metadata) override
+    {
+        return string_from_code(metadata.type) == type_;
+    }
 };
 
 class creator_filter_t : public filter_t
@@ -220,16 +294,51 @@ public:
     {
         return file.creator() == creator_;
     }
+    bool matches(const file_metadata_t &metadata) override
+    {
+        return string_from_code(metadata.creator) == creator_;
+    }
 };
 
 //  Accumulates all files in a list
 //  Holds a set of files to exclude
+//  With content comparison, the content keys are computed by gHashPool if there is one,
+//  and the excluded files are dropped once their key is known
 class file_accumulator_t : public file_visitor_t
 {
+    //  A file, with its key or the future of its content key
+    struct entry_t
+    {
+        std::shared_ptr<File> file;
+        std::string key;
+        std::future<std::string> pending_key;
+    };
+
     std::vector<std::shared_ptr<File>> found_files_;
-    std::unordered_set<std::string> exclude_keys_;
+    std::vector<std::string> found_keys_;
+    std::vector<entry_t> pending_; // Files visited after the found files, whose content key may not be known yet
+    //  Read-only while visiting, shared with the forks
+    std::shared_ptr<std::unordered_set<std::string>> exclude_keys_ = std::make_shared<std::unordered_set<std::string>>();
     bool use_content_comparison_;
 
+    //  Waits for the content keys of the pending files, and adds the ones that are not excluded
+    void resolve()
+    {
+        for (auto &entry : pending_)
+        {
+            if (entry.pending_key.valid())
+            {
+                entry.key = entry.pending_key.get();
+            }
+            if (exclude_keys_->find(entry.key) == exclude_keys_->end())
+            {
+                found_files_.push_back(std::move(entry.file));
+                found_keys_.push_back(std::move(entry.key));
+            }
+        }
+        pending_.clear();
+    }
+
 public:
     file_accumulator_t(bool use_content_comparison = false) : use_content_comparison_(use_content_comparison) {}
     file_accumulator_t(const std::vector<std::shared_ptr<File>> &exclusion, bool use_content_comparison = false)
@@ -237,49 +346,62 @@ public:
     {
         for (const auto &file : exclusion)
         {
-            exclude_keys_.insert(get_file_key(file));
+            exclude_keys_->insert(get_file_key(file));
         }
     }
 
-    void visit_file(std::shared_ptr<File> file) override
+    std::shared_ptr<file_visitor_t> fork() const override
     {
-        auto key = get_file_key(file);
-        bool excluded = is_excluded(file);
-        
-        if (!excluded)
+        auto accumulator = std::make_shared<file_accumulator_t>(use_content_comparison_);
+        accumulator->exclude_keys_ = exclude_keys_;
+        return accumulator;
+    }
+
+    //  The files of the fork are pending, as the ones visited before them may be
+    void merge(file_visitor_t &other) override
+    {
+        auto &accumulator = static_cast<file_accumulator_t &>(other);
+        for (size_t i = 0; i != accumulator.found_files_.size(); i++)
         {
-            found_files_.push_back(file);
-            file->retain_folder();
+            pending_.push_back({std::move(accumulator.found_files_[i]), std::move(accumulator.found_keys_[i]), {}});
         }
+        std::move(accumulator.pending_.begin(), accumulator.pending_.end(), std::back_inserter(pending_));
+        accumulator.found_files_.clear();
+        accumulator.found_keys_.clear();
+        accumulator.pending_.clear();
     }
 
-    const std::vector<std::shared_ptr<File>> &get_found_files() const { return found_files_; }
-    void clear() { found_files_.clear(); }
-
-    void switch_exclusion()
+    void visit_file(std::shared_ptr<File> file) override
     {
-        exclude_keys_.clear();
-        std::map<std::string, int> key_counts;
-        
-        for (const auto &file : found_files_)
+        if (use_content_comparison_ && gHashPool)
         {
-            auto key = get_file_key(file);
-            exclude_keys_.insert(key);
-            key_counts[key]++;
-            
+            auto pending_key = gHashPool->submit([file]
+                                                 { return file->content_key(); });
+            pending_.push_back({std::move(file), "", std::move(pending_key)});
+            return;
         }
-        
-        clear();
+        pending_.push_back({file, get_file_key(file), {}});
+        resolve();
     }
-    
-    bool is_excluded(const std::shared_ptr<File> &file) const
+
+    const std::vector<std::shared_ptr<File>> &get_found_files()
     {
-        auto key = get_file_key(file);
-        bool excluded = exclude_keys_.find(key) != exclude_keys_.end();
-        
-        return excluded;
+        resolve();
+        return found_files_;
     }
-    
+    void clear()
+    {
+        found_files_.clear();
+        found_keys_.clear();
+    }
+
+    void switch_exclusion()
+    {
+        resolve();
+        exclude_keys_ = std::make_shared<std::unordered_set<std::string>>(found_keys_.begin(), found_keys_.end());
+        clear();
+    }
+
 private:
     std::string get_file_key(const std::shared_ptr<File> &file) const
     {
@@ -288,30 +410,263 @@ private:
 };
 
 //  Collects files and groups them by content/metadata key to find duplicates
+//  Groups the files with the same key, or the same content
+//  Content is compared in stages, so most files are never read: files are bucketed by type, creator
+//  and fork sizes, files alone in their bucket are not hashed, the others get a partial hash of their
+//  data fork, and only the files whose partial hash collides get a full content key
+//  Content keys are computed in batches of md5_multi_t::lanes() files, whose data forks are hashed together,
+//  by gHashPool if there is one: the traversal goes on, and the keys are collected when merging and dumping
 class duplicate_detector_t : public file_visitor_t
 {
+    //  Size of the start and of the end of the data fork covered by a partial hash
+    static const uint32_t partial_hash_size = 4096;
+
+    //  A file, with the hashes computed so far (empty if not computed)
+    struct candidate_t
+    {
+        std::shared_ptr<File> file;
+        std::string partial_hash;
+        std::string content_key;
+        bool pending = false; // Waits for the next batch of content keys
+    };
+
+    //  Files with the same type, creator and fork sizes
+    struct bucket_t
+    {
+        std::vector<candidate_t> files;
+        std::map<std::string, std::vector<size_t>> partial_hashes; // Partial hash -> files, once the bucket has two files
+    };
+
     std::map<std::string, std::vector<std::shared_ptr<File>>> file_groups_;
+    std::map<std::string, bucket_t> buckets_; // Used instead of file_groups_ for content comparison
+    std::vector<std::pair<bucket_t *, size_t>> pending_; // Files of the next batch of content keys
+
+    //  A batch of content keys being computed by gHashPool
+    struct batch_t
+    {
+        std::vector<std::pair<bucket_t *, size_t>> files;
+        std::future<std::vector<std::string>> keys;
+    };
+    std::vector<batch_t> batches_;
     bool use_content_comparison_;
 
+    //  Bytes read by each stage, for --stats
+    size_t partial_hash_count_ = 0;
+    uint64_t partial_hash_bytes_ = 0;
+    size_t content_key_count_ = 0;
+    uint64_t content_key_bytes_ = 0;
+
+    void compute_partial_hash(candidate_t &candidate)
+    {
+        if (!candidate.partial_hash.empty())
+        {
+            return;
+        }
+
+        auto &file = *candidate.file;
+        try
+        {
+            auto hasher = make_hasher(gContentHash);
+            if (file.data_size() <= 2 * partial_hash_size)
+            {
+                auto data = file.read_data(0, file.data_size());
+                hasher->update(data.data(), data.size());
+                partial_hash_bytes_ += data.size();
+            }
+            else
+            {
+                auto start = file.read_data(0, partial_hash_size);
+                auto end = file.read_data(file.data_size() - partial_hash_size, partial_hash_size);
+                hasher->update(start.data(), start.size());
+                hasher->update(end.data(), end.size());
+                partial_hash_bytes_ += start.size() + end.size();
+            }
+            candidate.partial_hash = hasher->digest();
+        }
+        catch (const std::exception &)
+        {
+            candidate.partial_hash = "error";
+        }
+        partial_hash_count_++;
+    }
+
+    void request_content_key(bucket_t &bucket, size_t index)
+    {
+        auto &candidate = bucket.files[index];
+        if (candidate.content_key.empty() && !candidate.pending)
+        {
+            candidate.pending = true;
+            pending_.push_back({&bucket, index});
+            if (pending_.size() >= md5_multi_t::lanes())
+            {
+                compute_content_keys();
+            }
+        }
+    }
+
+    void compute_content_keys()
+    {
+        if (pending_.empty())
+        {
+            return;
+        }
+        std::vector<std::shared_ptr<File>> files;
+        for (auto [bucket, index] : pending_)
+        {
+            files.push_back(bucket->files[index].file);
+        }
+        if (gHashPool)
+        {
+            auto keys = gHashPool->submit([files = std::move(files)]
+                                          { return File::content_keys(files); });
+            batches_.push_back({std::move(pending_), std::move(keys)});
+        }
+        else
+        {
+            set_content_keys(pending_, File::content_keys(files));
+        }
+        pending_.clear();
+    }
+
+    //  Waits for the batches of gHashPool
+    void collect_content_keys()
+    {
+        for (auto &batch : batches_)
+        {
+            set_content_keys(batch.files, batch.keys.get());
+        }
+        batches_.clear();
+    }
+
+    void set_content_keys(const std::vector<std::pair<bucket_t *, size_t>> &files, const std::vector<std::string> &keys)
+    {
+        for (size_t i = 0; i != files.size(); i++)
+        {
+            auto &candidate = files[i].first->files[files[i].second];
+            candidate.content_key = keys[i];
+            candidate.pending = false;
+            content_key_count_++;
+            content_key_bytes_ += candidate.file->data_size() + candidate.file->rsrc_size();
+        }
+    }
+
+    //  Adds a file to its bucket, hashing it only if other files of the bucket may have the same content
+    void add_candidate(candidate_t candidate)
+    {
+        auto &file = *candidate.file;
+        auto &bucket = buckets_[std::format("{}|{}|{}|{}", file.type(), file.creator(), file.data_size(), file.rsrc_size())];
+        if (bucket.files.size() == 1)
+        {
+            compute_partial_hash(bucket.files[0]);
+            bucket.partial_hashes[bucket.files[0].partial_hash].push_back(0);
+        }
+        if (!bucket.files.empty())
+        {
+            compute_partial_hash(candidate);
+            auto &same_partial_hash = bucket.partial_hashes[candidate.partial_hash];
+            bool collides = !same_partial_hash.empty();
+            if (collides)
+            {
+                request_content_key(bucket, same_partial_hash[0]);
+            }
+            same_partial_hash.push_back(bucket.files.size());
+            bucket.files.push_back(std::move(candidate));
+            if (collides)
+            {
+                request_content_key(bucket, bucket.files.size() - 1);
+            }
+            return;
+        }
+        bucket.files.push_back(std::move(candidate));
+    }
+
+    //  The files grouped by content key, only for the files that have one
+    std::map<std::string, std::vector<std::shared_ptr<File>>> content_groups() const
+    {
+        std::map<std::string, std::vector<std::shared_ptr<File>>> groups;
+        for (const auto &[key, bucket] : buckets_)
+        {
+            for (const auto &candidate : bucket.files)
+            {
+                if (!candidate.content_key.empty())
+                {
+                    groups[candidate.content_key].push_back(candidate.file);
+                }
+            }
+        }
+        return groups;
+    }
+
 public:
     duplicate_detector_t(bool use_content_comparison = false) : use_content_comparison_(use_content_comparison) {}
 
     void visit_file(std::shared_ptr<File> file) override
     {
-        auto key = get_file_key(file);
-        file->retain_folder();
-        file_groups_[key].push_back(file);
+        if (use_content_comparison_)
+        {
+            add_candidate({file, "", ""});
+            return;
+        }
+        file_groups_[file->key()].push_back(file);
+    }
+
+    std::shared_ptr<file_visitor_t> fork() const override
+    {
+        return std::make_shared<duplicate_detector_t>(use_content_comparison_);
+    }
+
+    //  Hashes computed by the fork are kept, files of the fork may need more if they collide with ours
+    void merge(file_visitor_t &other) override
+    {
+        auto &detector = static_cast<duplicate_detector_t &>(other);
+        detector.collect_content_keys();
+        for (auto &[key, files] : detector.file_groups_)
+        {
+            auto &group = file_groups_[key];
+            group.insert(group.end(), files.begin(), files.end());
+        }
+        //  Files of the fork waiting for a content key are added to a batch of ours if they still collide
+        for (auto &[key, bucket] : detector.buckets_)
+        {
+            for (auto &candidate : bucket.files)
+            {
+                candidate.pending = false;
+                add_candidate(std::move(candidate));
+            }
+        }
+        partial_hash_count_ += detector.partial_hash_count_;
+        partial_hash_bytes_ += detector.partial_hash_bytes_;
+        content_key_count_ += detector.content_key_count_;
+        content_key_bytes_ += detector.content_key_bytes_;
+        detector.file_groups_.clear();
+        detector.buckets_.clear();
+        detector.pending_.clear();
     }
 
-    void dump_duplicates() const
+    void dump_duplicates()
     {
         size_t duplicate_group_count = 0;
         size_t total_duplicate_files = 0;
+        compute_content_keys();
+        collect_content_keys();
         
+        if (use_content_comparison_ && gStats)
+        {
+            std::cerr << std::format("Duplicates: {} partial hashes ({} bytes), {} content keys ({} bytes)\n",
+                                     partial_hash_count_, partial_hash_bytes_, content_key_count_, content_key_bytes_);
+        }
+
+        std::map<std::string, std::vector<std::shared_ptr<File>>> file_content_groups;
+        if (use_content_comparison_)
+        {
+            file_content_groups = content_groups();
+        }
+        const auto &groups = use_content_comparison_ ? file_content_groups : file_groups_;
+
         // Create a vector of duplicate groups (key, files pairs)
         std::vector<std::pair<std::string, std::vector<std::shared_ptr<File>>>> duplicate_groups;
         
-        for (const auto &[key, files] : file_groups_)
+        for (const auto &[key, files] : groups)
         {
             if (files.size() > 1)  // Only include groups with duplicates
             {
@@ -336,7 +691,7 @@ public:
             
             for (const auto &file : files)
             {
-                std::string path = string_from_path(file->retained_path());
+                std::string path = string_from_path(file->path());
                 std::cout << std::format("  {} in {} ({})\n", 
                                        string_from_file(*file),
                                        string_from_disk(file->disk()),
@@ -356,11 +711,6 @@ public:
         }
     }
 
-private:
-    std::string get_file_key(const std::shared_ptr<File> &file) const
-    {
-        return use_content_comparison_ ? file->content_key() : file->key();
-    }
 };
 
 class file_printer_t : public file_visitor_t
@@ -485,11 +835,10 @@ private:
             return;
         }
         
-        // Convert to string for MD5 calculation
-        std::string data_str(icon_data->begin(), icon_data->end());
-        
         // Calculate MD5 hash
-        std::string md5_hash = MD5(data_str).toStr();
+        MD5 md5;
+        md5.update(icon_data->data(), icon_data->size());
+        std::string md5_hash = md5.toStr();
         
         // Create source description
         std::string source = std::format("{}:{} ({} ID {})", 
@@ -568,6 +917,20 @@ public:
             // Silently ignore parsing errors for now
         }
     }
+
+    std::shared_ptr<file_visitor_t> fork() const override
+    {
+        return std::make_shared<icon_extractor_t>();
+    }
+
+    void merge(file_visitor_t &other) override
+    {
+        for (auto& [md5_hash, icon_infos] : static_cast<icon_extractor_t&>(other).unique_icons_) {
+            auto& infos = unique_icons_[md5_hash];
+            std::move(icon_infos.begin(), icon_infos.end(), std::back_inserter(infos));
+        }
+        static_cast<icon_extractor_t&>(other).unique_icons_.clear();
+    }
     
     void dump_icons() const
     {
@@ -592,6 +955,82 @@ public:
     }
 };
 
+//  Counts files, and optionally reads all their forks, to measure mount time and read throughput
+//  When a hash function is given, the forks are streamed through a hasher instead
+class fork_reader_t : public file_visitor_t
+{
+    bool read_forks_;
+    std::optional<hash_algorithm_t> hash_;
+    size_t file_count_ = 0;
+    uint64_t byte_count_ = 0;
+
+public:
+    fork_reader_t(bool read_forks, std::optional<hash_algorithm_t> hash = {}) : read_forks_(read_forks), hash_(hash) {}
+
+    void visit_file(std::shared_ptr<File> file) override
+    {
+        file_count_++;
+        if (read_forks_ && hash_)
+        {
+            auto hasher = make_hasher(*hash_);
+            byte_count_ += file->hash_data(*hasher);
+            byte_count_ += file->hash_rsrc(*hasher);
+            hasher->digest();
+        }
+        else if (read_forks_)
+        {
+            byte_count_ += file->read_data_all().size();
+            byte_count_ += file->read_rsrc_all().size();
+        }
+    }
+
+    std::shared_ptr<file_visitor_t> fork() const override
+    {
+        return std::make_shared<fork_reader_t>(read_forks_, hash_);
+    }
+
+    void merge(file_visitor_t &other) override
+    {
+        file_count_ += static_cast<fork_reader_t &>(other).file_count_;
+        byte_count_ += static_cast<fork_reader_t &>(other).byte_count_;
+    }
+
+    size_t file_count() const { return file_count_; }
+    uint64_t byte_count() const { return byte_count_; }
+};
+
+//  Computes the content keys of the files, one at a time, or all together with File::content_keys,
+//  which hashes forks of the same size in the lanes of md5_multi_t like the colliding files of dups --content
+class content_key_reader_t : public file_visitor_t
+{
+    bool batched_;
+    std::vector<std::shared_ptr<File>> batch_;
+    uint64_t byte_count_ = 0;
+
+public:
+    content_key_reader_t(bool batched) : batched_(batched) {}
+
+    void visit_file(std::shared_ptr<File> file) override
+    {
+        byte_count_ += file->data_size() + file->rsrc_size();
+        if (batched_)
+        {
+            batch_.push_back(file);
+            return;
+        }
+        file->content_key();
+    }
+
+    //  Computes the keys of the files of the batch
+    void finish()
+    {
+        File::content_keys(batch_);
+        batch_.clear();
+    }
+
+    uint64_t byte_count() const { return byte_count_; }
+};
+
 // class dump_visitor_t : public file_visitor_t
 // {
 //     size_t indent_ = 0;
@@ -743,47 +1182,130 @@ std::vector<std::shared_ptr<datasource_t>> expand_source(const std::shared_ptr<d
     return sources;
 }
 
-void process_disk_image(const std::filesystem::path &filepath, file_visitor_t &visitor, std::vector<std::shared_ptr<Folder>> * = nullptr)
+//  A partition of a disk image, mounted with the files accepted by the visitor
+struct mounted_partition_t
 {
-    ENTRY("{}", filepath.string());
+    std::shared_ptr<partition_t> partition;
+    std::shared_ptr<Folder> root;
+    std::string error;                      //  Mount or visit error, reported when the partition is visited
+    std::exception_ptr exception;           //  Fatal error, rethrown when the partition is visited
+    std::shared_ptr<file_visitor_t> forked; //  Fork that already visited the partition, merged when the partition is visited
+};
 
-    // Create initial data source
-    auto file_source = std::make_shared<file_datasource_t>(filepath);
-    rs_log("Analyzing disk image: {} ({})", filepath.c_str(), file_source->size());
+//  Creates the partition of a data source, without mounting it
+mounted_partition_t open_partition(const std::shared_ptr<datasource_t> &source)
+{
+    mounted_partition_t mounted;
+    mounted.partition = partition_t::create(source);
+    if (!mounted.partition)
+    {
+        rs_log("Unknown partition type for {}", source->description());
+    }
+    return mounted;
+}
 
-    auto sources = expand_source(file_source);
+//  Mounts a partition lazily, so that the visitor can reject files before they are created
+void mount_partition(mounted_partition_t &mounted, file_visitor_t &visitor)
+{
+    if (!mounted.partition)
+    {
+        return;
+    }
 
-    for (auto &source : sources)
+    try
     {
-        auto partition = partition_t::create(source);
-        if (partition)
+        mounted.root = mounted.partition->get_root_folder_for(visitor);
+    }
+    catch (const std::exception &error)
+    {
+        mounted.error = error.what();
+    }
+}
+
+//  Mounts a partition and visits it with a fork of the visitor, on the current thread
+//  The fork is merged into the visitor later, by visit_partition
+void mount_and_visit_partition(mounted_partition_t &mounted, file_visitor_t &visitor)
+{
+    auto forked = visitor.fork();
+    if (!forked)
+    {
+        mount_partition(mounted, visitor);
+        return;
+    }
+
+    mount_partition(mounted, *forked);
+    if (mounted.root && mounted.error.empty())
+    {
+        try
         {
-            try
-            {
-                auto root = partition->get_root_folder();
-                visit_folder(root, visitor);
-            }
-            catch (const std::exception &error)
-            {
-                std::cerr << "\033[31mError parsing partition\033[0m : " << filepath << " (" << file_source->size() << " bytes) ";
-                std::cerr << ": " << error.what() << "\n";
-            }
+            visit_folder(mounted.root, *forked);
         }
-        else
+        catch (const std::exception &exception)
         {
-            rs_log("Unknown partition type for {}", source->description());
+            mounted.error = exception.what();
         }
     }
+    mounted.forked = forked;
 }
 
-void process_single_path(const std::filesystem::path &path, file_visitor_t &visitor)
+//  Visits a mounted partition (or merges the fork that visited it) and reports its errors
+void visit_partition(const mounted_partition_t &mounted, const std::filesystem::path &filepath, uint64_t image_size, file_visitor_t &visitor)
 {
-    ENTRY("{}", path.c_str());
-    if (std::filesystem::is_directory(path))
+    if (mounted.exception)
     {
-        try
-        {
-            for (const auto &entry : std::filesystem::recursive_directory_iterator(path))
+        std::rethrow_exception(mounted.exception);
+    }
+
+    std::string error = mounted.error;
+    if (mounted.forked)
+    {
+        visitor.merge(*mounted.forked);
+    }
+    else if (mounted.root && error.empty())
+    {
+        try
+        {
+            visit_folder(mounted.root, visitor);
+        }
+        catch (const std::exception &exception)
+        {
+            error = exception.what();
+        }
+    }
+
+    if (!error.empty())
+    {
+        std::cerr << "\033[31mError parsing partition\033[0m : " << filepath << " (" << image_size << " bytes) ";
+        std::cerr << ": " << error << "\n";
+    }
+}
+
+void process_disk_image(const std::filesystem::path &filepath, file_visitor_t &visitor, std::vector<std::shared_ptr<Folder>> * = nullptr)
+{
+    ENTRY("{}", filepath.string());
+
+    // Create initial data source
+    auto file_source = std::make_shared<mmap_datasource_t>(filepath);
+    rs_log("Analyzing disk image: {} ({})", filepath.c_str(), file_source->size());
+
+    auto sources = expand_source(file_source);
+
+    for (auto &source : sources)
+    {
+        auto mounted = open_partition(source);
+        mount_partition(mounted, visitor);
+        visit_partition(mounted, filepath, file_source->size(), visitor);
+    }
+}
+
+void process_single_path(const std::filesystem::path &path, file_visitor_t &visitor)
+{
+    ENTRY("{}", path.c_str());
+    if (std::filesystem::is_directory(path))
+    {
+        try
+        {
+            for (const auto &entry : std::filesystem::recursive_directory_iterator(path))
             {
                 if (std::filesystem::is_regular_file(entry.path()))
                     process_disk_image(entry.path(), visitor);
@@ -805,15 +1327,623 @@ void process_single_path(const std::filesystem::path &path, file_visitor_t &visi
     }
 }
 
+//  Lists the disk images of a path, in the order they are processed by process_single_path
+void collect_disk_images(const std::filesystem::path &path, std::vector<std::filesystem::path> &images)
+{
+    if (std::filesystem::is_directory(path))
+    {
+        try
+        {
+            for (const auto &entry : std::filesystem::recursive_directory_iterator(path))
+            {
+                if (std::filesystem::is_regular_file(entry.path()))
+                    images.push_back(entry.path());
+            }
+        }
+        catch (const std::filesystem::filesystem_error &e)
+        {
+            std::cerr << "Error accessing directory " << path << ": " << e.what() << "\n";
+        }
+    }
+    else if (std::filesystem::is_regular_file(path))
+    {
+        images.push_back(path);
+    }
+    else
+    {
+        std::cerr << "Error: " << path << " is not a regular file or directory\n";
+        throw std::runtime_error("Invalid path type");
+    }
+}
+
+//  A disk image going through the stages of a pipelined scan
+struct scanned_image_t
+{
+    std::filesystem::path filepath;
+    uint64_t size = 0;
+    std::vector<mounted_partition_t> partitions;
+    std::exception_ptr exception;     //  Opening the image failed
+    std::atomic<size_t> remaining{0}; //  Partitions still being mounted
+    std::promise<void> mounted;
+    std::future<void> mounted_future = mounted.get_future();
+};
+
+//  Time spent working by a stage of a pipelined scan, summed over its threads
+struct stage_time_t
+{
+    std::atomic<int64_t> nanoseconds{0};
+
+    void add_since(std::chrono::steady_clock::time_point start)
+    {
+        nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    double seconds() const { return nanoseconds / 1e9; }
+};
+
+//  Processes the disk images in three stages, each running ahead of the next one:
+//    - prefetch: a thread opens the images, creates their partitions and asks the datasources
+//      to fetch the metadata that mounting will read (headers, catalog and extents B-trees)
+//    - mount: a pool of workers mounts each partition as a separate task
+//      Visitors that can fork are visited by the workers, in a fork per partition
+//    - visit: the calling thread visits the partitions (or merges their forks) in the order of a serial scan
+//  So the output is the same as the one of a serial scan
+//  Each stage holds at most depth images more than the next one, so I/O and parsing overlap
+//  while memory stays bounded
+void process_paths_pipelined(const std::vector<std::filesystem::path> &paths, file_visitor_t &visitor, size_t jobs, size_t depth)
+{
+    std::vector<std::filesystem::path> images;
+    for (const auto &path : paths)
+    {
+        collect_disk_images(path, images);
+    }
+
+    stage_time_t prefetch_time, mount_time, visit_time;
+    std::chrono::steady_clock::duration mount_wait{};
+    using image_queue_t = bounded_queue_t<std::shared_ptr<scanned_image_t>>;
+    image_queue_t opened(depth);   //  Prefetched, waiting to be mounted
+    image_queue_t mounting(depth); //  Being mounted, waiting to be visited
+    work_pool_t pool(jobs);
+
+    auto prefetch_stage = [&]
+    {
+        for (const auto &filepath : images)
+        {
+            auto start = std::chrono::steady_clock::now();
+            auto image = std::make_shared<scanned_image_t>();
+            image->filepath = filepath;
+            try
+            {
+                auto file_source = std::make_shared<mmap_datasource_t>(filepath);
+                image->size = file_source->size();
+                for (auto &source : expand_source(file_source))
+                {
+                    mounted_partition_t partition;
+                    try
+                    {
+                        partition = open_partition(source);
+                        if (partition.partition)
+                        {
+                            partition.partition->prefetch();
+                        }
+                    }
+                    catch (...)
+                    {
+                        partition.exception = std::current_exception();
+                    }
+                    image->partitions.push_back(std::move(partition));
+                }
+            }
+            catch (...)
+            {
+                image->exception = std::current_exception();
+            }
+            prefetch_time.add_since(start);
+
+            if (!opened.push(image))
+            {
+                break;
+            }
+        }
+        opened.close();
+    };
+
+    auto mount_stage = [&]
+    {
+        std::shared_ptr<scanned_image_t> image;
+        while (opened.pop(image))
+        {
+            image->remaining = image->partitions.size();
+            if (image->partitions.empty())
+            {
+                image->mounted.set_value();
+            }
+            for (size_t i = 0; i != image->partitions.size(); i++)
+            {
+                pool.submit([&visitor, &mount_time, image, i]
+                            {
+                    auto start = std::chrono::steady_clock::now();
+                    auto &partition = image->partitions[i];
+                    if (!partition.exception)
+                    {
+                        try
+                        {
+                            mount_and_visit_partition(partition, visitor);
+                        }
+                        catch (...)
+                        {
+                            partition.exception = std::current_exception();
+                        }
+                    }
+                    mount_time.add_since(start);
+                    if (--image->remaining == 0)
+                    {
+                        image->mounted.set_value();
+                    } });
+            }
+
+            if (!mounting.push(image))
+            {
+                break;
+            }
+        }
+        mounting.close();
+    };
+
+    //  Stops the first stages if the visit stage throws
+    struct stages_t
+    {
+        image_queue_t &opened;
+        image_queue_t &mounting;
+        std::thread prefetch;
+        std::thread mount;
+        ~stages_t()
+        {
+            opened.close();
+            mounting.close();
+            prefetch.join();
+            mount.join();
+        }
+    } stages{opened, mounting, std::thread(prefetch_stage), std::thread(mount_stage)};
+
+    std::shared_ptr<scanned_image_t> image;
+    while (mounting.pop(image))
+    {
+        auto wait_start = std::chrono::steady_clock::now();
+        image->mounted_future.wait();
+        auto start = std::chrono::steady_clock::now();
+        mount_wait += start - wait_start;
+
+        if (image->exception)
+        {
+            std::rethrow_exception(image->exception);
+        }
+        for (const auto &partition : image->partitions)
+        {
+            visit_partition(partition, image->filepath, image->size, visitor);
+        }
+        visit_time.add_since(start);
+    }
+
+    if (gStats)
+    {
+        std::chrono::duration<double> visit_wait = mounting.pop_wait() + mount_wait;
+        std::cerr << std::format("Pipeline: {} images, {} mount workers, queue depth {}\n", images.size(), pool.size(), depth);
+        std::cerr << std::format("  prefetch: busy {:.3f} s, blocked {:.3f} s on a full queue (max {}, mean {:.1f})\n",
+                                 prefetch_time.seconds(), opened.push_wait().count(), opened.max_depth(), opened.mean_depth());
+        std::cerr << std::format("  mount:    busy {:.3f} s, blocked {:.3f} s on a full queue (max {}, mean {:.1f})\n",
+                                 mount_time.seconds(), mounting.push_wait().count(), mounting.max_depth(), mounting.mean_depth());
+        std::cerr << std::format("  visit:    busy {:.3f} s, waited {:.3f} s for mounts\n",
+                                 visit_time.seconds(), visit_wait.count());
+    }
+}
+
 void process_paths(const std::vector<std::filesystem::path> &paths, file_visitor_t &visitor)
 {
     ENTRY("{}", paths.size());
+    if (gJobs > 1 || gPipeline)
+    {
+        process_paths_pipelined(paths, visitor, gJobs, gQueueDepth ? gQueueDepth : gJobs * 4);
+        return;
+    }
+
     for (const auto &path : paths)
     {
         process_single_path(path, visitor);
     }
 }
 
+//  Mounts each path repeat times, then mounts it and reads all of its forks repeat times
+//  and prints the mount time and the read throughput, then the throughput of each hash function
+//  Running it on the same volume in different containers (ie: raw and CD-ROM BIN)
+//  compares the cost of the datasource stacks
+void benchmark_paths(const std::vector<std::filesystem::path> &paths, int repeat)
+{
+    for (const auto &path : paths)
+    {
+        fork_reader_t mounter(false);
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < repeat; i++)
+        {
+            process_single_path(path, mounter);
+        }
+        std::chrono::duration<double> mount_elapsed = std::chrono::steady_clock::now() - start;
+
+        fork_reader_t reader(true);
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < repeat; i++)
+        {
+            process_single_path(path, reader);
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        double mb = reader.byte_count() / (1024.0 * 1024.0);
+        std::cout << std::format("{}: {} files, mount {:.3f} ms, {:.1f} MB in {:.3f} s ({:.1f} MB/s)",
+                                 path.string(),
+                                 mounter.file_count() / repeat,
+                                 mount_elapsed.count() * 1000.0 / repeat,
+                                 mb,
+                                 elapsed.count(),
+                                 elapsed.count() > 0 ? mb / elapsed.count() : 0.0);
+
+        for (auto hash : {hash_algorithm_t::md5, hash_algorithm_t::xxh64})
+        {
+            fork_reader_t hasher(true, hash);
+            start = std::chrono::steady_clock::now();
+            for (int i = 0; i < repeat; i++)
+            {
+                process_single_path(path, hasher);
+            }
+            std::chrono::duration<double> hash_elapsed = std::chrono::steady_clock::now() - start;
+            double hash_mb = hasher.byte_count() / (1024.0 * 1024.0);
+            std::cout << std::format(", {} {:.1f} MB/s", hash_name(hash), hash_elapsed.count() > 0 ? hash_mb / hash_elapsed.count() : 0.0);
+        }
+
+        //  Content keys, with the data forks hashed one at a time, then in the lanes of md5_multi_t
+        for (bool batched : {false, true})
+        {
+            content_key_reader_t keys(batched);
+            start = std::chrono::steady_clock::now();
+            for (int i = 0; i < repeat; i++)
+            {
+                process_single_path(path, keys);
+                keys.finish();
+            }
+            std::chrono::duration<double> keys_elapsed = std::chrono::steady_clock::now() - start;
+            double keys_mb = keys.byte_count() / (1024.0 * 1024.0);
+            std::cout << std::format(", content keys {} {:.1f} MB/s",
+                                     batched ? std::format("{} x{}", md5_multi_t::engine(), md5_multi_t::lanes()) : hash_name(gContentHash),
+                                     keys_elapsed.count() > 0 ? keys_mb / keys_elapsed.count() : 0.0);
+        }
+        std::cout << "\n";
+    }
+}
+
+//  Writes the data fork (or the resource fork) of the file at a colon separated path
+//  (ie: "Disk:Folder:File") to the standard output
+//  HFS volumes resolve the path with catalog lookups, without building their folder hierarchy
+bool cat_file(const std::filesystem::path &filepath, const std::string &path, bool rsrc)
+{
+    auto file_source = std::make_shared<mmap_datasource_t>(filepath);
+
+    for (auto &source : expand_source(file_source))
+    {
+        auto partition = partition_t::create(source);
+        if (!partition)
+        {
+            continue;
+        }
+
+        try
+        {
+            auto file = partition->find_file(path);
+            if (file)
+            {
+                auto content = rsrc ? file->read_rsrc_all() : file->read_data_all();
+                std::cout.write(reinterpret_cast<const char *>(content.data()), content.size());
+                return true;
+            }
+        }
+        catch (const std::exception &error)
+        {
+            std::cerr << "\033[31mError parsing partition\033[0m : " << filepath << " (" << file_source->size() << " bytes) ";
+            std::cerr << ": " << error.what() << "\n";
+        }
+    }
+
+    return false;
+}
+
+//  Builds a collection index of the disk images of the paths
+//  Each partition is visited by the index writer, which records its folders and files
+//  With update, the images of the existing index are copied without being parsed when their size,
+//  modification time, inode and header hash did not change
+//  The images of the existing index that are not found in the paths are kept as tombstones
+void index_paths(const std::vector<std::filesystem::path> &paths, const std::filesystem::path &out, bool update)
+{
+    std::vector<std::filesystem::path> images;
+    for (const auto &path : paths)
+    {
+        collect_disk_images(path, images);
+    }
+
+    std::unique_ptr<collection_index_t> previous;
+    std::unordered_map<std::string, uint32_t> previous_images; // Path -> image in the previous index
+    if (update && std::filesystem::exists(out))
+    {
+        previous = std::make_unique<collection_index_t>(out);
+        if (gContent && !previous->has_content_keys())
+        {
+            std::cerr << "The index has no content keys, all images are indexed again\n";
+            previous.reset();
+        }
+        else if (gContent && previous->content_hash() != gContentHash)
+        {
+            std::cerr << std::format("The content keys of the index use {}, all images are indexed again\n",
+                                     hash_name(previous->content_hash()));
+            previous.reset();
+        }
+        else
+        {
+            for (uint32_t i = 0; i != previous->images().size(); i++)
+            {
+                previous_images[std::string(previous->string(previous->images()[i].path))] = i;
+            }
+        }
+    }
+    std::vector<bool> found(previous ? previous->images().size() : 0);
+
+    collection_writer_t writer(gContent);
+    size_t added = 0, changed = 0, unchanged = 0, removed = 0;
+    for (const auto &filepath : images)
+    {
+        rsx_image_t signature{};
+        stat_image(filepath, signature);
+
+        uint32_t indexed = RSX_NONE;
+        auto it = previous_images.find(filepath.string());
+        if (it != previous_images.end())
+        {
+            found[it->second] = true;
+            if (!(previous->images()[it->second].flags & RSX_IMAGE_DELETED))
+            {
+                indexed = it->second;
+            }
+        }
+
+        //  An image is only reused when both its stat and its header hash match the indexed ones
+        auto file_source = std::make_shared<mmap_datasource_t>(filepath);
+        hash_image_header(*file_source, signature);
+
+        if (indexed != RSX_NONE && same_image_stat(previous->images()[indexed], signature) &&
+            std::memcmp(previous->images()[indexed].header_hash, signature.header_hash, sizeof(signature.header_hash)) == 0)
+        {
+            writer.copy_image(*previous, indexed, signature);
+            unchanged++;
+            continue;
+        }
+
+        (indexed != RSX_NONE ? changed : added)++;
+        writer.add_image(filepath, signature);
+
+        for (auto &source : expand_source(file_source))
+        {
+            auto mounted = open_partition(source);
+            if (!mounted.partition)
+            {
+                continue;
+            }
+            writer.add_partition();
+            mount_partition(mounted, writer);
+            visit_partition(mounted, filepath, file_source->size(), writer);
+        }
+    }
+
+    //  Tombstones, for the images that are gone and the ones that were already gone
+    for (uint32_t i = 0; i != found.size(); i++)
+    {
+        const auto &image = previous->images()[i];
+        if (!found[i])
+        {
+            writer.add_deleted_image(std::string(previous->string(image.path)), image);
+            removed += !(image.flags & RSX_IMAGE_DELETED);
+        }
+    }
+
+    writer.write(out);
+    std::cout << std::format("Indexed {} files in {} disk images into {} ({} added, {} changed, {} unchanged, {} removed)\n",
+                             writer.file_count(), images.size(), out.string(), added, changed, unchanged, removed);
+}
+
+//  A query of a collection index
+struct index_query_t
+{
+    std::string name;    // Name pattern, as for --name (empty for any name)
+    std::string type;    // Type code (empty for any type)
+    std::string creator; // Creator code (empty for any creator)
+    bool group = false;
+    bool dups = false;
+    bool content = false;
+    bool folders = false; // Lists the folders matching the name pattern instead of files
+    bool codes = false;   // Counts the files of each type and creator instead of listing them
+};
+
+//  Answers list, --group and --dups queries from a collection index, without opening the disk images
+//  The output is the one of the list (or dups) command on the indexed paths,
+//  except that list does not dump the resource forks
+//  The files are selected by intersecting the bitmaps of their type and creator with the matches
+//  of the name pattern in the trigram index, so only the selected file records are read
+void query_index(const std::filesystem::path &path, const index_query_t &query)
+{
+    collection_index_t index(path);
+    if (query.dups && query.content && !index.has_content_keys())
+    {
+        throw std::runtime_error("The index has no content keys, build it with --content");
+    }
+
+    auto files = index.files();
+    auto partitions = index.partitions();
+
+    if (query.folders)
+    {
+        for (auto folder : index.find_folders(query.name))
+        {
+            const auto &image = index.images()[partitions[index.folder_partition(folder)].image];
+            std::cout << std::format("{} in {}\n", index.folder_path(folder), index.string(image.path));
+        }
+        return;
+    }
+
+    //  Codes of another length than four characters match no file
+    file_selection_t selection(files.size(), true);
+    if (!query.type.empty())
+    {
+        selection.intersect(query.type.size() == 4 ? index.type_files(rsx_code(query.type)) : code_bitmap_t{});
+    }
+    if (!query.creator.empty())
+    {
+        selection.intersect(query.creator.size() == 4 ? index.creator_files(rsx_code(query.creator)) : code_bitmap_t{});
+    }
+    if (!query.name.empty())
+    {
+        selection.intersect(index.find_files(query.name));
+    }
+
+    if (query.codes)
+    {
+        //  Counted on the bitmaps, without reading the file records
+        bool all = query.name.empty() && query.type.empty() && query.creator.empty();
+        std::cout << std::format("{} files\n", selection.count());
+        for (auto [title, codes] : {std::pair{"Types", index.types()}, std::pair{"Creators", index.creators()}})
+        {
+            std::cout << title << ":\n";
+            for (const auto &code : codes)
+            {
+                size_t count = all ? code.count : selection.count(index.files(code));
+                if (count)
+                {
+                    std::cout << std::format("  {} {} files\n", string_from_code(code.code), count);
+                }
+            }
+        }
+        return;
+    }
+
+    auto string_from_indexed_disk = [&](const rsx_file_t &file)
+    {
+        const auto &partition = partitions[file.partition];
+        return std::format("{} in {}", index.string(partition.disk_name), index.string(partition.disk_path));
+    };
+
+    //  The selected files, with their metadata
+    std::vector<std::pair<const rsx_file_t *, indexed_file_t>> found;
+    for (auto i : selection.files())
+    {
+        const auto &file = files[i];
+        found.emplace_back(&file, indexed_file_t{sanitize_string(std::string(index.string(file.name))),
+                                                 string_from_code(file.type),
+                                                 string_from_code(file.creator),
+                                                 file.data_size,
+                                                 file.rsrc_size});
+    }
+
+    if (query.dups)
+    {
+        //  Same grouping and ordering as duplicate_detector_t
+        std::map<std::string, std::vector<size_t>> file_groups;
+        for (size_t i = 0; i != found.size(); i++)
+        {
+            const auto &[file, metadata] = found[i];
+            auto key = query.content ? std::string(index.string(file->content_key))
+                               : std::format("{}|{}|{}|{}|{}", index.string(file->name), metadata.type, metadata.creator, metadata.data_size, metadata.rsrc_size);
+            file_groups[key].push_back(i);
+        }
+
+        std::vector<std::pair<std::string, std::vector<size_t>>> duplicate_groups;
+        for (const auto &[key, group] : file_groups)
+        {
+            if (group.size() > 1)
+            {
+                duplicate_groups.emplace_back(key, group);
+            }
+        }
+        std::sort(duplicate_groups.begin(), duplicate_groups.end(),
+                  [&](const auto &a, const auto &b)
+                  { return found[a.second[0]].second.name < found[b.second[0]].second.name; });
+
+        size_t total_duplicate_files = 0;
+        for (size_t g = 0; g != duplicate_groups.size(); g++)
+        {
+            const auto &[key, group] = duplicate_groups[g];
+            total_duplicate_files += group.size();
+            std::cout << std::format("=== Duplicate group {} ({} files) ===\n", g + 1, group.size());
+            std::cout << std::format("Key: {}\n", key);
+            for (auto i : group)
+            {
+                std::string folder = index.folder_path(found[i].first->folder);
+                std::cout << std::format("  {} in {} ({})\n",
+                                         string_from_file(found[i].second),
+                                         string_from_indexed_disk(*found[i].first),
+                                         folder.empty() ? "root" : folder);
+            }
+            std::cout << "\n";
+        }
+
+        if (duplicate_groups.empty())
+        {
+            std::cout << "No duplicate files found.\n";
+        }
+        else
+        {
+            std::cout << std::format("Summary: {} duplicate groups with {} total files\n",
+                                     duplicate_groups.size(), total_duplicate_files);
+        }
+        return;
+    }
+
+    if (query.group)
+    {
+        //  Same grouping and ordering as FileSet
+        std::map<std::string, std::vector<size_t>> groups;
+        for (size_t i = 0; i != found.size(); i++)
+        {
+            const auto &metadata = found[i].second;
+            groups[metadata.name + "|" + metadata.type + "|" + metadata.creator].push_back(i);
+        }
+
+        std::cout << "Found " << groups.size() << " groups with a total of " << found.size() << " files.\n";
+        for (const auto &[key, group] : groups)
+        {
+            const auto &first = found[group[0]].second;
+            uint32_t min_data_size = 0xffffffff;
+            uint32_t min_rsrc_size = 0xffffffff;
+            uint32_t max_data_size = 0;
+            uint32_t max_rsrc_size = 0;
+            for (auto i : group)
+            {
+                min_data_size = std::min(min_data_size, found[i].second.data_size);
+                min_rsrc_size = std::min(min_rsrc_size, found[i].second.rsrc_size);
+                max_data_size = std::max(max_data_size, found[i].second.data_size);
+                max_rsrc_size = std::max(max_rsrc_size, found[i].second.rsrc_size);
+            }
+            std::cout << std::format("{} {}/{} {} occurences {}\n",
+                                     first.name, first.type, first.creator, group.size(),
+                                     string_from_fork_sizes(min_data_size, max_data_size, min_rsrc_size, max_rsrc_size));
+            for (auto i : group)
+            {
+                std::cout << "    Disk: " << string_from_indexed_disk(*found[i].first) << "\n";
+                std::cout << "          Path: " << index.folder_path(found[i].first->folder) << "\n";
+            }
+        }
+        return;
+    }
+
+    for (const auto &[file, metadata] : found)
+    {
+        std::cout << string_from_file(metadata) << "\n";
+    }
+}
+
 /*
     All arguments in the for --xxx=yyy or --xxx form are returned in the map 1st argument
     For the rest:
@@ -872,6 +2002,48 @@ std::tuple<std::string, std::map<std::string, std::string>, std::vector<std::fil
 
 using namespace std::string_literals;
 
+//  Prints the statistics when leaving main, if requested with --stats
+struct stats_reporter_t
+{
+    ~stats_reporter_t()
+    {
+        if (gStats)
+        {
+            std::cerr << std::format("Cache: {} hits, {} misses\n",
+                                     cached_datasource_t::total_hits(),
+                                     cached_datasource_t::total_misses());
+            if (gHashCache)
+            {
+                std::cerr << std::format("Hash cache: {} hits, {} misses\n", gHashCache->hits(), gHashCache->misses());
+            }
+            if (gHashPool)
+            {
+                std::cerr << std::format("Hash pool: {} threads, blocked {:.3f} s on a full queue (max {}, mean {:.1f})\n",
+                                         gHashPool->size(), gHashPool->submit_wait().count(), gHashPool->max_depth(), gHashPool->mean_depth());
+            }
+        }
+    }
+};
+
+//  Saves the hashes computed by the command when leaving main
+struct hash_cache_saver_t
+{
+    ~hash_cache_saver_t()
+    {
+        if (gHashCache)
+        {
+            try
+            {
+                gHashCache->save();
+            }
+            catch (const std::exception &e)
+            {
+                std::cerr << "Error: " << e.what() << "\n";
+            }
+        }
+    }
+};
+
 /*
     retroscope list <file_or_directories> [--type=XXXX] [--creator=XXXX] [--name=substring] [--group]
 */
@@ -880,21 +2052,42 @@ int main(int argc, char *argv[])
 {
     if (argc < 2)
     {
-        std::cerr << "Usage: " << argv[0] << " {list|diff|icon|dups} <disk_image_file_or_directory> [additional_paths...]\n";
+        std::cerr << "Usage: " << argv[0] << " {list|diff|icon|dups|bench|cat|index|query} <disk_image_file_or_directory> [additional_paths...]\n";
         std::cerr << "Analyzes vintage Macintosh HFS disk images and list content.\n";
         std::cerr << "Commands:\n";
         std::cerr << "  list - List files in the disk images\n";
         std::cerr << "  diff - Show files that differ between disk images\n";
         std::cerr << "  icon - Extract and deduplicate ICON resources using MD5 hashes\n";
         std::cerr << "  dups - Find and show duplicate files across disk images\n";
+        std::cerr << "  bench - Report mount time and fork read and hash throughput of each path\n";
+        std::cerr << "  cat - Write a file of a disk image to the standard output (cat <image> <Disk:Folder:File>)\n";
+        std::cerr << "  index - Write a collection index of the disk images (index <paths> --out=collection.rsx)\n";
+        std::cerr << "  query - List files from a collection index (query collection.rsx [--group|--dups])\n";
         std::cerr << "If a directory is provided, recursively processes all files in it.\n";
         std::cerr << "Multiple paths can be specified to process them all.\n";
         std::cerr << "Options:\n";
         std::cerr << "  --type=XXXX    Filter by file type\n";
         std::cerr << "  --creator=XXXX Filter by file creator\n";
-        std::cerr << "  --name=substr  Filter by filename substring\n";
+        std::cerr << "  --name=substr  Filter by filename substring, or by glob pattern with * and ?\n";
         std::cerr << "  --group        Group files by type/creator (list command only)\n";
         std::cerr << "  --content      Use MD5 content comparison (diff and dups commands)\n";
+        std::cerr << "  --hash=NAME    Hash of the content comparison, md5 (default) or xxh64\n";
+        std::cerr << "  --cache=KB     Per-partition metadata cache budget (0 disables the cache)\n";
+        std::cerr << "  --cache-page=N Cache page size in bytes\n";
+        std::cerr << "  --stats        Print cache statistics at exit\n";
+        std::cerr << "  --hash-cache=F Keep the content hashes of the forks in F, so later runs only hash new files\n";
+        std::cerr << "  --hash-jobs=N  Number of threads hashing the forks while the images are traversed (diff and dups commands)\n";
+        std::cerr << "  --leaf-chain   Walk HFS B-trees node by node instead of reading them sequentially\n";
+        std::cerr << "  --repeat=N     Number of passes over each path (bench command only)\n";
+        std::cerr << "  --jobs=N       Number of images mounted in parallel (0 for one per core)\n";
+        std::cerr << "  --pipeline     Prefetch, mount and visit the images in separate stages (implied by --jobs)\n";
+        std::cerr << "  --queue=N      Number of images each pipeline stage runs ahead of the next (default 4 per job)\n";
+        std::cerr << "  --rsrc         Write the resource fork instead of the data fork (cat command only)\n";
+        std::cerr << "  --out=FILE     Index file to write (index command only, --content adds content keys)\n";
+        std::cerr << "  --update       Only index the images that changed since the index was written (index command only)\n";
+        std::cerr << "  --dups         Find duplicate files instead of listing them (query command only)\n";
+        std::cerr << "  --folders      List the folders matching --name instead of files (query command only)\n";
+        std::cerr << "  --codes        Count the files of each type and creator instead of listing them (query command only)\n";
         return 1;
     }
 
@@ -903,9 +2096,10 @@ int main(int argc, char *argv[])
         // Parse command line arguments
         auto [command, flags, paths] = parse_arguments(argc, argv);
 
-        if (command != "list" && command != "diff" && command != "icon" && command != "dups")
+        if (command != "list" && command != "diff" && command != "icon" && command != "dups" && command != "bench" && command != "cat" &&
+            command != "index" && command != "query")
         {
-            std::cerr << "Error: First argument must be 'list', 'diff', 'icon', or 'dups'\n";
+            std::cerr << "Error: First argument must be 'list', 'diff', 'icon', 'dups', 'bench', 'cat', 'index' or 'query'\n";
             return 1;
         }
 
@@ -921,6 +2115,58 @@ int main(int argc, char *argv[])
         gName = get_arg(flags, "name", ""s);
         gGroup = get_arg(flags, "group", false);
         gContent = get_arg(flags, "content", false);
+        gStats = get_arg(flags, "stats", false);
+        gLeafChain = get_arg(flags, "leaf-chain", false);
+        if (!hash_from_name(get_arg(flags, "hash", std::string(hash_name(gContentHash))), gContentHash))
+        {
+            std::cerr << "Error: unknown hash (md5 or xxh64)\n";
+            return 1;
+        }
+
+        int cache_kb = get_arg(flags, "cache", static_cast<int>(gCacheSize / 1024));
+        int cache_page = get_arg(flags, "cache-page", static_cast<int>(gCachePageSize));
+        if (cache_kb < 0 || cache_page <= 0)
+        {
+            std::cerr << "Error: invalid cache configuration\n";
+            return 1;
+        }
+        int jobs = get_arg(flags, "jobs", static_cast<int>(gJobs));
+        if (jobs < 0)
+        {
+            std::cerr << "Error: invalid number of jobs\n";
+            return 1;
+        }
+        gJobs = jobs > 0 ? static_cast<size_t>(jobs) : std::max(1u, std::thread::hardware_concurrency());
+        gPipeline = get_arg(flags, "pipeline", false);
+        int queue_depth = get_arg(flags, "queue", static_cast<int>(gQueueDepth));
+        if (queue_depth < 0)
+        {
+            std::cerr << "Error: invalid queue depth\n";
+            return 1;
+        }
+        gQueueDepth = static_cast<size_t>(queue_depth);
+
+        gCacheSize = static_cast<size_t>(cache_kb) * 1024;
+        gCachePageSize = static_cast<size_t>(cache_page);
+        stats_reporter_t stats_reporter;
+
+        auto hash_cache = get_arg(flags, "hash-cache", ""s);
+        if (!hash_cache.empty())
+        {
+            gHashCache = std::make_shared<hash_cache_t>(hash_cache);
+        }
+        hash_cache_saver_t hash_cache_saver;
+
+        int hash_jobs = get_arg(flags, "hash-jobs", 0);
+        if (hash_jobs < 0)
+        {
+            std::cerr << "Error: invalid number of hash jobs\n";
+            return 1;
+        }
+        if (hash_jobs > 0)
+        {
+            gHashPool = std::make_shared<hash_pool_t>(hash_jobs, 4 * hash_jobs);
+        }
 
         //  If gType is in the form of "XXXX/XXXX" split into type and creator
         size_t slash_pos = gType.find('/');
@@ -944,6 +2190,51 @@ int main(int argc, char *argv[])
             filters.push_back(std::make_shared<creator_filter_t>(gCreator));
         }
 
+        if (command == "bench")
+        {
+            benchmark_paths(paths, std::max(1, get_arg(flags, "repeat", 1)));
+            return 0;
+        }
+
+        if (command == "cat")
+        {
+            if (paths.size() != 2)
+            {
+                std::cerr << "Error: 'cat' command requires a disk image and a file path\n";
+                return 1;
+            }
+            if (!cat_file(paths[0], paths[1].string(), get_arg(flags, "rsrc", false)))
+            {
+                std::cerr << "Error: " << paths[1].string() << " not found in " << paths[0] << "\n";
+                return 1;
+            }
+            return 0;
+        }
+
+        if (command == "index")
+        {
+            auto out = get_arg(flags, "out", ""s);
+            if (out.empty())
+            {
+                std::cerr << "Error: 'index' command requires --out=<index file>\n";
+                return 1;
+            }
+            index_paths(paths, out, get_arg(flags, "update", false));
+            return 0;
+        }
+
+        if (command == "query")
+        {
+            if (paths.size() != 1)
+            {
+                std::cerr << "Error: 'query' command requires a single index file\n";
+                return 1;
+            }
+            query_index(paths[0], {gName, gType, gCreator, gGroup, get_arg(flags, "dups", false), gContent,
+                                   get_arg(flags, "folders", false), get_arg(flags, "codes", false)});
+            return 0;
+        }
+
         if (command == "icon")
         {
             auto icon_extractor = std::make_shared<icon_extractor_t>();
@@ -1023,7 +2314,7 @@ int main(int argc, char *argv[])
             for (auto &file : group->files)
             {
                 std::cout << "    Disk: " << string_from_disk(file->disk()) << std::endl;
-                std::cout << "          Path: " << string_from_path(file->retained_path()) << std::endl;
+                std::cout << "          Path: " << string_from_path(file->path()) << std::endl;
             }
         }
     }
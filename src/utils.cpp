@@ -5,12 +5,22 @@
 #include <format>
 #include <cctype>
 #include <algorithm>
+#include <array>
+#include <iterator>
+#include <stdexcept>
 
 std::string gType = "";
 std::string gCreator = "";
 std::string gName = "";
 bool gGroup = false;
 bool gContent = false;
+size_t gCacheSize = 4 * 1024 * 1024;
+size_t gCachePageSize = 8 * 1024;
+bool gStats = false;
+bool gLeafChain = false;
+size_t gJobs = 1;
+bool gPipeline = false;
+size_t gQueueDepth = 0; // 0 for 4 images per job
 
 // Convert Pascal string to C++ string
 std::string string_from_pstring(const uint8_t *pascalStr)
@@ -45,36 +55,37 @@ std::string string_from_code(uint32_t code)
     return std::string(chars);
 }
 
+// MacRoman to Unicode mapping table for characters 0x80-0xFF
+// Characters 0x00-0x7F are identical to ASCII/UTF-8
+static const uint16_t macroman_to_unicode[128] = {
+    // 0x80-0x8F
+    0x00C4, 0x00C5, 0x00C7, 0x00C9, 0x00D1, 0x00D6, 0x00DC, 0x00E1,
+    0x00E0, 0x00E2, 0x00E4, 0x00E3, 0x00E5, 0x00E7, 0x00E9, 0x00E8,
+    // 0x90-0x9F
+    0x00EA, 0x00EB, 0x00ED, 0x00EC, 0x00EE, 0x00EF, 0x00F1, 0x00F3,
+    0x00F2, 0x00F4, 0x00F6, 0x00F5, 0x00FA, 0x00F9, 0x00FB, 0x00FC,
+    // 0xA0-0xAF
+    0x2020, 0x00B0, 0x00A2, 0x00A3, 0x00A7, 0x2022, 0x00B6, 0x00DF,
+    0x00AE, 0x00A9, 0x2122, 0x00B4, 0x00A8, 0x2260, 0x00C6, 0x00D8,
+    // 0xB0-0xBF
+    0x221E, 0x00B1, 0x2264, 0x2265, 0x00A5, 0x00B5, 0x2202, 0x2211,
+    0x220F, 0x03C0, 0x222B, 0x00AA, 0x00BA, 0x03A9, 0x00E6, 0x00F8,
+    // 0xC0-0xCF
+    0x00BF, 0x00A1, 0x00AC, 0x221A, 0x0192, 0x2248, 0x2206, 0x00AB,
+    0x00BB, 0x2026, 0x00A0, 0x00C0, 0x00C3, 0x00D5, 0x0152, 0x0153,
+    // 0xD0-0xDF
+    0x2013, 0x2014, 0x201C, 0x201D, 0x2018, 0x2019, 0x00F7, 0x25CA,
+    0x00FF, 0x0178, 0x2044, 0x20AC, 0x2039, 0x203A, 0xFB01, 0xFB02,
+    // 0xE0-0xEF
+    0x2021, 0x00B7, 0x201A, 0x201E, 0x2030, 0x00C2, 0x00CA, 0x00C1,
+    0x00CB, 0x00C8, 0x00CD, 0x00CE, 0x00CF, 0x00CC, 0x00D3, 0x00D4,
+    // 0xF0-0xFF
+    0xF8FF, 0x00D2, 0x00DA, 0x00DB, 0x00D9, 0x0131, 0x02C6, 0x02DC,
+    0x00AF, 0x02D8, 0x02D9, 0x02DA, 0x00B8, 0x02DD, 0x02DB, 0x02C7};
+
 // Convert MacRoman encoded string to UTF-8
 std::string from_macroman(const std::string &macroman_str)
 {
-    // MacRoman to Unicode mapping table for characters 0x80-0xFF
-    // Characters 0x00-0x7F are identical to ASCII/UTF-8
-    static const uint16_t macroman_to_unicode[128] = {
-        // 0x80-0x8F
-        0x00C4, 0x00C5, 0x00C7, 0x00C9, 0x00D1, 0x00D6, 0x00DC, 0x00E1,
-        0x00E0, 0x00E2, 0x00E4, 0x00E3, 0x00E5, 0x00E7, 0x00E9, 0x00E8,
-        // 0x90-0x9F
-        0x00EA, 0x00EB, 0x00ED, 0x00EC, 0x00EE, 0x00EF, 0x00F1, 0x00F3,
-        0x00F2, 0x00F4, 0x00F6, 0x00F5, 0x00FA, 0x00F9, 0x00FB, 0x00FC,
-        // 0xA0-0xAF
-        0x2020, 0x00B0, 0x00A2, 0x00A3, 0x00A7, 0x2022, 0x00B6, 0x00DF,
-        0x00AE, 0x00A9, 0x2122, 0x00B4, 0x00A8, 0x2260, 0x00C6, 0x00D8,
-        // 0xB0-0xBF
-        0x221E, 0x00B1, 0x2264, 0x2265, 0x00A5, 0x00B5, 0x2202, 0x2211,
-        0x220F, 0x03C0, 0x222B, 0x00AA, 0x00BA, 0x03A9, 0x00E6, 0x00F8,
-        // 0xC0-0xCF
-        0x00BF, 0x00A1, 0x00AC, 0x221A, 0x0192, 0x2248, 0x2206, 0x00AB,
-        0x00BB, 0x2026, 0x00A0, 0x00C0, 0x00C3, 0x00D5, 0x0152, 0x0153,
-        // 0xD0-0xDF
-        0x2013, 0x2014, 0x201C, 0x201D, 0x2018, 0x2019, 0x00F7, 0x25CA,
-        0x00FF, 0x0178, 0x2044, 0x20AC, 0x2039, 0x203A, 0xFB01, 0xFB02,
-        // 0xE0-0xEF
-        0x2021, 0x00B7, 0x201A, 0x201E, 0x2030, 0x00C2, 0x00CA, 0x00C1,
-        0x00CB, 0x00C8, 0x00CD, 0x00CE, 0x00CF, 0x00CC, 0x00D3, 0x00D4,
-        // 0xF0-0xFF
-        0xF8FF, 0x00D2, 0x00DA, 0x00DB, 0x00D9, 0x0131, 0x02C6, 0x02DC,
-        0x00AF, 0x02D8, 0x02D9, 0x02DA, 0x00B8, 0x02DD, 0x02DB, 0x02C7};
 
     std::string utf8_result;
     utf8_result.reserve(macroman_str.size() * 2); // Reserve space for potential expansion
@@ -115,6 +126,86 @@ std::string from_macroman(const std::string &macroman_str)
     return utf8_result;
 }
 
+// Convert UTF-8 string to MacRoman encoding
+// Returns false with the reason in error if the string is not valid UTF-8 or has characters outside of MacRoman
+static bool convert_to_macroman(const std::string &utf8_str, std::string &macroman_result, std::string &error)
+{
+    macroman_result.reserve(utf8_str.size());
+
+    for (size_t i = 0; i < utf8_str.size();)
+    {
+        unsigned char c = utf8_str[i];
+        uint32_t unicode;
+        size_t length;
+
+        // Decode one UTF-8 sequence (up to the Basic Multilingual Plane, like from_macroman)
+        if (c < 0x80)
+        {
+            unicode = c;
+            length = 1;
+        }
+        else if ((c & 0xE0) == 0xC0)
+        {
+            unicode = c & 0x1F;
+            length = 2;
+        }
+        else if ((c & 0xF0) == 0xE0)
+        {
+            unicode = c & 0x0F;
+            length = 3;
+        }
+        else
+        {
+            error = "Invalid UTF-8 string";
+            return false;
+        }
+
+        if (i + length > utf8_str.size())
+        {
+            error = "Truncated UTF-8 string";
+            return false;
+        }
+        for (size_t j = 1; j < length; j++)
+        {
+            unsigned char continuation = utf8_str[i + j];
+            if ((continuation & 0xC0) != 0x80)
+            {
+                error = "Invalid UTF-8 string";
+                return false;
+            }
+            unicode = (unicode << 6) | (continuation & 0x3F);
+        }
+        i += length;
+
+        if (unicode < 0x80)
+        {
+            macroman_result += static_cast<char>(unicode);
+            continue;
+        }
+
+        auto it = std::find(std::begin(macroman_to_unicode), std::end(macroman_to_unicode), unicode);
+        if (it == std::end(macroman_to_unicode))
+        {
+            error = std::format("Character U+{:04X} has no MacRoman equivalent", unicode);
+            return false;
+        }
+        macroman_result += static_cast<char>(0x80 + (it - std::begin(macroman_to_unicode)));
+    }
+
+    return true;
+}
+
+std::string to_macroman(const std::string &utf8_str)
+{
+    std::string macroman_result;
+    std::string error;
+    if (!convert_to_macroman(utf8_str, macroman_result, error))
+    {
+        throw std::invalid_argument(error);
+    }
+    return macroman_result;
+}
+
 void dump(const uint8_t *data, size_t size)
 {
     for (size_t i = 0; i < size; i += 16)
@@ -225,6 +316,126 @@ bool has_case_insensitive_substring(const std::string &source, const std::string
     return it != source.end();
 }
 
+bool equals_case_insensitive(std::string_view a, std::string_view b)
+{
+    return std::equal(a.begin(), a.end(), b.begin(), b.end(),
+                      [](char c1, char c2)
+                      {
+                          return std::tolower(static_cast<unsigned char>(c1)) ==
+                                 std::tolower(static_cast<unsigned char>(c2));
+                      });
+}
+
+// Lowercase of each MacRoman character: ASCII letters and the accented capitals
+static const auto macroman_lowercase = []
+{
+    std::array<uint8_t, 256> table;
+    for (size_t c = 0; c != table.size(); c++)
+    {
+        table[c] = static_cast<uint8_t>(c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c);
+    }
+    static const uint8_t accented[][2] = {
+        {0x80, 0x8A}, {0x81, 0x8C}, {0x82, 0x8D}, {0x83, 0x8E}, {0x84, 0x96}, {0x85, 0x9A}, {0x86, 0x9F}, {0xAE, 0xBE},
+        {0xAF, 0xBF}, {0xCB, 0x88}, {0xCC, 0x8B}, {0xCD, 0x9B}, {0xCE, 0xCF}, {0xD9, 0xD8}, {0xE5, 0x89}, {0xE6, 0x90},
+        {0xE7, 0x87}, {0xE8, 0x91}, {0xE9, 0x8F}, {0xEA, 0x92}, {0xEB, 0x94}, {0xEC, 0x95}, {0xED, 0x93}, {0xEE, 0x97},
+        {0xEF, 0x99}, {0xF1, 0x98}, {0xF2, 0x9C}, {0xF3, 0x9E}, {0xF4, 0x9D}};
+    for (const auto &[upper, lower] : accented)
+    {
+        table[upper] = lower;
+    }
+    return table;
+}();
+
+// Case fold a MacRoman string, the same as fold_case on its UTF-8 conversion
+std::string fold_macroman(std::string_view macroman_str)
+{
+    std::string result(macroman_str);
+    for (auto &c : result)
+    {
+        c = static_cast<char>(macroman_lowercase[static_cast<unsigned char>(c)]);
+    }
+    return result;
+}
+
+// Case fold a UTF-8 string into lowercase MacRoman, one byte per character
+// Strings with characters outside of MacRoman are only folded for ASCII
+std::string fold_case(const std::string &utf8_str)
+{
+    std::string result;
+    std::string error;
+    bool macroman = convert_to_macroman(utf8_str, result, error);
+    if (!macroman)
+    {
+        result = utf8_str;
+    }
+
+    for (auto &c : result)
+    {
+        auto byte = static_cast<unsigned char>(c);
+        if (macroman || byte < 0x80)
+        {
+            c = static_cast<char>(macroman_lowercase[byte]);
+        }
+    }
+    return result;
+}
+
+// Check if a name matches a pattern, both case folded
+// A pattern with '*' (any characters) or '?' (one character) must match the whole name,
+// other patterns match any part of it
+bool matches_name_pattern(std::string_view folded_name, std::string_view folded_pattern)
+{
+    if (folded_pattern.find_first_of("*?") == std::string_view::npos)
+    {
+        return folded_name.find(folded_pattern) != std::string_view::npos;
+    }
+
+    // Glob matching, backtracking to the last '*' on a mismatch
+    size_t n = 0, p = 0;
+    size_t star = std::string_view::npos, star_n = 0;
+    while (n != folded_name.size())
+    {
+        if (p != folded_pattern.size() && (folded_pattern[p] == '?' || folded_pattern[p] == folded_name[n]))
+        {
+            n++;
+            p++;
+        }
+        else if (p != folded_pattern.size() && folded_pattern[p] == '*')
+        {
+            star = p++;
+            star_n = n;
+        }
+        else if (star != std::string_view::npos)
+        {
+            p = star + 1;
+            n = ++star_n;
+        }
+        else
+        {
+            return false;
+        }
+    }
+    while (p != folded_pattern.size() && folded_pattern[p] == '*')
+    {
+        p++;
+    }
+    return p == folded_pattern.size();
+}
+
+// Split a string on a separator, keeping empty components
+std::vector<std::string> split_string(const std::string &str, char separator)
+{
+    std::vector<std::string> result;
+    size_t start = 0;
+    for (size_t end = str.find(separator); end != std::string::npos; end = str.find(separator, start))
+    {
+        result.push_back(str.substr(start, end - start));
+        start = end + 1;
+    }
+    result.push_back(str.substr(start));
+    return result;
+}
+
 // Static variable for log indentation
 static int log_indent = 0;
 
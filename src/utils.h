@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <cstdint>
 #include <format>
@@ -13,13 +14,26 @@ extern std::string gCreator;
 extern std::string gName;
 extern bool gGroup;
 extern bool gContent;
+extern size_t gCacheSize;
+extern size_t gCachePageSize;
+extern bool gStats;
+extern bool gLeafChain;
+extern size_t gJobs;
+extern bool gPipeline;
+extern size_t gQueueDepth;
 
 // Utility function declarations
 std::string string_from_pstring(const uint8_t *pascalStr);
 std::string string_from_code(uint32_t code);
 std::string from_macroman(const std::string &macroman_str);
+std::string to_macroman(const std::string &utf8_str);
 std::string sanitize_string(const std::string &str);
 bool has_case_insensitive_substring(const std::string &source, const std::string &sub);
+bool equals_case_insensitive(std::string_view a, std::string_view b);
+std::string fold_case(const std::string &utf8_str);
+std::string fold_macroman(std::string_view macroman_str);
+bool matches_name_pattern(std::string_view folded_name, std::string_view folded_pattern);
+std::vector<std::string> split_string(const std::string &str, char separator);
 void dump(const std::vector<uint8_t> &data);
 void dump(const uint8_t *data, size_t size);
 
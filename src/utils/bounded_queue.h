@@ -0,0 +1,106 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+
+/**
+ * Fixed capacity queue between the stages of a pipeline.
+ * push() blocks while the queue is full and pop() while it is empty,
+ * so a fast stage cannot run more than capacity items ahead of the next one.
+ * Once closed, push() drops its item and pop() drains the remaining items.
+ */
+template <typename T>
+class bounded_queue_t
+{
+    std::mutex mutex_;
+    std::condition_variable not_full_;
+    std::condition_variable not_empty_;
+    std::deque<T> items_;
+    size_t capacity_;
+    bool closed_ = false;
+
+    size_t pushes_ = 0;
+    size_t depth_sum_ = 0; // Sum of the depths seen by each push, for the mean depth
+    size_t max_depth_ = 0;
+    std::chrono::steady_clock::duration push_wait_{};
+    std::chrono::steady_clock::duration pop_wait_{};
+
+public:
+    /**
+     * Create an empty queue.
+     * @param capacity Maximum number of items in the queue (at least 1)
+     */
+    explicit bounded_queue_t(size_t capacity) : capacity_(std::max<size_t>(capacity, 1)) {}
+
+    /**
+     * Add an item, waiting for room if the queue is full.
+     * @param item The item
+     * @return False if the queue was closed, the item is then dropped
+     */
+    bool push(T item)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        auto start = std::chrono::steady_clock::now();
+        not_full_.wait(lock, [this]
+                       { return items_.size() < capacity_ || closed_; });
+        push_wait_ += std::chrono::steady_clock::now() - start;
+        if (closed_)
+        {
+            return false;
+        }
+
+        items_.push_back(std::move(item));
+        pushes_++;
+        depth_sum_ += items_.size();
+        max_depth_ = std::max(max_depth_, items_.size());
+        not_empty_.notify_one();
+        return true;
+    }
+
+    /**
+     * Remove the oldest item, waiting for one if the queue is empty.
+     * @param item Receives the item
+     * @return False if the queue is closed and empty
+     */
+    bool pop(T &item)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        auto start = std::chrono::steady_clock::now();
+        not_empty_.wait(lock, [this]
+                        { return !items_.empty() || closed_; });
+        pop_wait_ += std::chrono::steady_clock::now() - start;
+        if (items_.empty())
+        {
+            return false;
+        }
+
+        item = std::move(items_.front());
+        items_.pop_front();
+        not_full_.notify_one();
+        return true;
+    }
+
+    /**
+     * Close the queue: wakes up all waiting producers and consumers.
+     */
+    void close()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closed_ = true;
+        not_full_.notify_all();
+        not_empty_.notify_all();
+    }
+
+    size_t capacity() const { return capacity_; }
+
+    // Statistics, only meaningful once the producers and consumers are done
+    size_t max_depth() const { return max_depth_; }
+    double mean_depth() const { return pushes_ ? static_cast<double>(depth_sum_) / pushes_ : 0.0; }
+    // Time spent by producers waiting on a full queue, and by consumers waiting on an empty one
+    std::chrono::duration<double> push_wait() const { return push_wait_; }
+    std::chrono::duration<double> pop_wait() const { return pop_wait_; }
+};
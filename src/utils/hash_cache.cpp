@@ -0,0 +1,190 @@
+#include "utils/hash_cache.h"
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+std::shared_ptr<hash_cache_t> gHashCache;
+
+//  Closes a file descriptor, which also releases its lock
+struct fd_closer_t
+{
+    int fd;
+    ~fd_closer_t() { ::close(fd); }
+};
+
+//  Reads a whole file from its start
+static std::string read_all(int fd, const std::filesystem::path &path)
+{
+    std::string content;
+    char buffer[64 * 1024];
+    for (off_t offset = 0;;)
+    {
+        ssize_t count = ::pread(fd, buffer, sizeof(buffer), offset);
+        if (count < 0)
+        {
+            throw std::runtime_error("Cannot read hash cache: " + path.string() + ": " + std::strerror(errno));
+        }
+        if (count == 0)
+        {
+            return content;
+        }
+        content.append(buffer, count);
+        offset += count;
+    }
+}
+
+//  Writes a whole buffer
+static void write_all(int fd, const std::string &content, const std::filesystem::path &path)
+{
+    for (size_t written = 0; written != content.size();)
+    {
+        ssize_t count = ::write(fd, content.data() + written, content.size() - written);
+        if (count < 0)
+        {
+            throw std::runtime_error("Cannot write hash cache: " + path.string() + ": " + std::strerror(errno));
+        }
+        written += count;
+    }
+}
+
+static std::string line_from_entry(const std::string &location, const std::string &fingerprint, const std::string &hash)
+{
+    return location + "\t" + fingerprint + "\t" + hash + "\n";
+}
+
+hash_cache_t::hash_cache_t(const std::filesystem::path &path) : path_(path)
+{
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        if (errno == ENOENT)
+        {
+            return;
+        }
+        throw std::runtime_error("Cannot open hash cache: " + path.string() + ": " + std::strerror(errno));
+    }
+    fd_closer_t closer{fd};
+    ::flock(fd, LOCK_SH);
+    lines_ = parse(read_all(fd, path));
+}
+
+size_t hash_cache_t::parse(const std::string &content)
+{
+    size_t lines = 0;
+    size_t start = 0;
+    for (size_t end = content.find('\n'); end != std::string::npos; start = end + 1, end = content.find('\n', start))
+    {
+        size_t tab1 = content.find('\t', start);
+        size_t tab2 = tab1 < end ? content.find('\t', tab1 + 1) : std::string::npos;
+        if (tab2 >= end || content.find('\t', tab2 + 1) < end)
+        {
+            continue; // Not a cache line
+        }
+        hashes_[content.substr(start, tab1 - start)] = {content.substr(tab1 + 1, tab2 - tab1 - 1), content.substr(tab2 + 1, end - tab2 - 1)};
+        lines++;
+    }
+    return lines;
+}
+
+bool hash_cache_t::find(const std::string &location, const std::string &fingerprint, std::string &hash) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = hashes_.find(location);
+    if (it == hashes_.end() || it->second.fingerprint != fingerprint)
+    {
+        misses_++;
+        return false;
+    }
+    hits_++;
+    hash = it->second.hash;
+    return true;
+}
+
+void hash_cache_t::add(const std::string &location, const std::string &fingerprint, const std::string &hash)
+{
+    auto storable = [](const std::string &string)
+    { return string.find_first_of("\t\n") == std::string::npos; };
+    if (!storable(location) || !storable(fingerprint) || !storable(hash))
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    hashes_[location] = {fingerprint, hash};
+    added_.push_back({location, {fingerprint, hash}});
+}
+
+void hash_cache_t::save()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (added_.empty())
+    {
+        return;
+    }
+
+    for (;;)
+    {
+        int fd = ::open(path_.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (fd < 0)
+        {
+            throw std::runtime_error("Cannot open hash cache: " + path_.string() + ": " + std::strerror(errno));
+        }
+        fd_closer_t closer{fd};
+        ::flock(fd, LOCK_EX);
+
+        //  Another run may have replaced the file while we waited for the lock
+        struct stat locked, current;
+        if (::fstat(fd, &locked) != 0 || ::stat(path_.c_str(), &current) != 0 ||
+            locked.st_dev != current.st_dev || locked.st_ino != current.st_ino)
+        {
+            continue;
+        }
+
+        if (lines_ + added_.size() <= 2 * hashes_.size())
+        {
+            std::string lines;
+            for (const auto &[location, entry] : added_)
+            {
+                lines += line_from_entry(location, entry.fingerprint, entry.hash);
+            }
+            write_all(fd, lines, path_);
+            lines_ += added_.size();
+            added_.clear();
+            return;
+        }
+
+        //  Rewrite the file with the current hashes, including the ones other runs added since it was loaded
+        hashes_.clear();
+        parse(read_all(fd, path_));
+        for (const auto &[location, entry] : added_)
+        {
+            hashes_[location] = entry;
+        }
+
+        std::string content;
+        for (const auto &[location, entry] : hashes_)
+        {
+            content += line_from_entry(location, entry.fingerprint, entry.hash);
+        }
+        auto temporary = path_;
+        temporary += ".tmp";
+        int out = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (out < 0)
+        {
+            throw std::runtime_error("Cannot create hash cache: " + temporary.string() + ": " + std::strerror(errno));
+        }
+        {
+            fd_closer_t out_closer{out};
+            write_all(out, content, temporary);
+        }
+        std::filesystem::rename(temporary, path_);
+        lines_ = hashes_.size();
+        added_.clear();
+        return;
+    }
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**
+ * Persistent cache of fork hashes, so that repeated runs only hash the forks of new or modified images.
+ * A hash is stored for a location (the partition, file number, fork and size of the fork) and is only
+ * valid for the fingerprint of the image file it was computed from: a location keeps a single hash,
+ * replaced when the image changes.
+ *
+ * The cache file is a log of "location<TAB>fingerprint<TAB>hash" lines, where later lines replace earlier ones.
+ * It is read under a shared lock, new hashes are appended under an exclusive lock, and it is rewritten
+ * without the replaced lines when they outnumber the others. A rewrite replaces the file atomically,
+ * so concurrent readers see either version, and a line cut short by a crash is ignored.
+ */
+class hash_cache_t
+{
+    struct entry_t
+    {
+        std::string fingerprint;
+        std::string hash;
+    };
+
+    std::filesystem::path path_;
+    mutable std::mutex mutex_;                          // Protects the hashes, they are used by the visitors of all workers
+    std::unordered_map<std::string, entry_t> hashes_;   // Location -> hash
+    std::vector<std::pair<std::string, entry_t>> added_; // Hashes not saved yet
+    size_t lines_ = 0;                                  // Lines of the cache file, including the replaced ones
+
+    mutable std::atomic<size_t> hits_ = 0;
+    mutable std::atomic<size_t> misses_ = 0;
+
+    /**
+     * Parse the lines of a cache file into the hashes.
+     * @param content The content of the file
+     * @return Number of valid lines
+     */
+    size_t parse(const std::string &content);
+
+public:
+    /**
+     * Load a cache.
+     * @param path Path of the cache file, which is created when the cache is saved if it does not exist
+     * @throws std::runtime_error if the file exists and cannot be read
+     */
+    explicit hash_cache_t(const std::filesystem::path &path);
+
+    /**
+     * Look up the hash of a fork.
+     * @param location Location of the fork
+     * @param fingerprint Fingerprint of the image file
+     * @param hash Receives the hash
+     * @return True if the cache has a hash for the location, computed from the same image file
+     */
+    bool find(const std::string &location, const std::string &fingerprint, std::string &hash) const;
+
+    /**
+     * Add the hash of a fork, replacing the previous hash of the location.
+     * Hashes whose strings hold tabs or newlines cannot be stored, and are ignored.
+     * @param location Location of the fork
+     * @param fingerprint Fingerprint of the image file
+     * @param hash The hash
+     */
+    void add(const std::string &location, const std::string &fingerprint, const std::string &hash);
+
+    /**
+     * Write the added hashes to the cache file, rewriting it if most of its lines were replaced.
+     * @throws std::runtime_error if the file cannot be written
+     */
+    void save();
+
+    size_t hits() const { return hits_; }
+    size_t misses() const { return misses_; }
+};
+
+//  The cache of the fork hashes, nullptr if hashes are not cached (see --hash-cache)
+extern std::shared_ptr<hash_cache_t> gHashCache;
@@ -0,0 +1,31 @@
+#include "utils/hash_pool.h"
+
+#include <algorithm>
+
+std::shared_ptr<hash_pool_t> gHashPool;
+
+hash_pool_t::hash_pool_t(size_t thread_count, size_t capacity) : queue_(capacity)
+{
+    thread_count = std::max<size_t>(thread_count, 1);
+    for (size_t i = 0; i != thread_count; i++)
+    {
+        threads_.emplace_back([this]
+                              {
+                                  std::function<void()> job;
+                                  while (queue_.pop(job))
+                                  {
+                                      job();
+                                  }
+                              });
+    }
+}
+
+hash_pool_t::~hash_pool_t()
+{
+    //  A closed queue still hands out its remaining jobs
+    queue_.close();
+    for (auto &thread : threads_)
+    {
+        thread.join();
+    }
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "utils/bounded_queue.h"
+
+#include <cstddef>
+#include <functional>
+#include <future>
+#include <memory>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/**
+ * Threads that hash forks while the traversal goes on.
+ * Visitors submit hashing jobs and get a future of their result, so walking the catalogs
+ * and hashing overlap, and several cores hash at once.
+ * Jobs wait in a bounded queue: submit() blocks while the queue is full, so the traversal
+ * never runs more than capacity jobs ahead of the hashing threads, and the files and
+ * results held by the pending jobs stay bounded.
+ */
+class hash_pool_t
+{
+    bounded_queue_t<std::function<void()>> queue_;
+    std::vector<std::thread> threads_;
+
+public:
+    /**
+     * Start the hashing threads.
+     * @param thread_count Number of threads (at least 1)
+     * @param capacity Number of jobs waiting for a thread before submit() blocks (at least 1)
+     */
+    hash_pool_t(size_t thread_count, size_t capacity);
+
+    /**
+     * Run the remaining jobs and join the threads.
+     */
+    ~hash_pool_t();
+
+    hash_pool_t(const hash_pool_t &) = delete;
+    hash_pool_t &operator=(const hash_pool_t &) = delete;
+
+    /**
+     * Queue a job, waiting for room if the queue is full.
+     * @param job The job, run on one of the threads; what it throws is rethrown by the future
+     * @return The future of the result of the job
+     */
+    template <typename F>
+    std::future<std::invoke_result_t<F>> submit(F job)
+    {
+        auto task = std::make_shared<std::packaged_task<std::invoke_result_t<F>()>>(std::move(job));
+        auto future = task->get_future();
+        queue_.push([task]
+                    { (*task)(); });
+        return future;
+    }
+
+    size_t size() const { return threads_.size(); }
+    size_t capacity() const { return queue_.capacity(); }
+
+    // Statistics, only meaningful once the traversal is done
+    size_t max_depth() const { return queue_.max_depth(); }
+    double mean_depth() const { return queue_.mean_depth(); }
+    // Time spent by the traversal waiting on a full queue
+    std::chrono::duration<double> submit_wait() const { return queue_.push_wait(); }
+};
+
+//  The hashing threads, nullptr if forks are hashed by the traversal (see --hash-jobs)
+extern std::shared_ptr<hash_pool_t> gHashPool;
@@ -0,0 +1,57 @@
+#include "utils/hasher.h"
+#include "utils/md5.h"
+#include "utils/xxhash.h"
+
+#include <format>
+
+hash_algorithm_t gContentHash = hash_algorithm_t::md5;
+
+namespace
+{
+
+class md5_hasher_t : public hasher_t
+{
+    MD5 md5_;
+
+public:
+    void update(const void *data, size_t size) override { md5_.update(static_cast<const byte *>(data), size); }
+    std::string digest() override { return md5_.toStr(); }
+};
+
+class xxh64_hasher_t : public hasher_t
+{
+    xxh64_t xxh64_;
+
+public:
+    void update(const void *data, size_t size) override { xxh64_.update(data, size); }
+    std::string digest() override { return std::format("{:016x}", xxh64_.digest()); }
+};
+
+} // namespace
+
+std::unique_ptr<hasher_t> make_hasher(hash_algorithm_t algorithm)
+{
+    if (algorithm == hash_algorithm_t::xxh64)
+    {
+        return std::make_unique<xxh64_hasher_t>();
+    }
+    return std::make_unique<md5_hasher_t>();
+}
+
+const char *hash_name(hash_algorithm_t algorithm)
+{
+    return algorithm == hash_algorithm_t::xxh64 ? "xxh64" : "md5";
+}
+
+bool hash_from_name(const std::string &name, hash_algorithm_t &algorithm)
+{
+    for (auto candidate : {hash_algorithm_t::md5, hash_algorithm_t::xxh64})
+    {
+        if (name == hash_name(candidate))
+        {
+            algorithm = candidate;
+            return true;
+        }
+    }
+    return false;
+}
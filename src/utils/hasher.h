@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+//  Hash functions of the content of forks
+enum class hash_algorithm_t
+{
+    md5,   // The default, content keys have always used it
+    xxh64, // Not cryptographic, much faster, good enough to find duplicates
+};
+
+/**
+ * Incremental hash of a stream of bytes, fed a chunk at a time.
+ */
+class hasher_t
+{
+public:
+    virtual ~hasher_t() = default;
+
+    /**
+     * Hash the next bytes of the stream.
+     * @param data The bytes
+     * @param size Number of bytes
+     */
+    virtual void update(const void *data, size_t size) = 0;
+
+    /**
+     * Get the hash of the bytes fed so far.
+     * @return The hash, as lowercase hexadecimal
+     */
+    virtual std::string digest() = 0;
+};
+
+/**
+ * Create a hasher.
+ * @param algorithm The hash function
+ * @return A hasher of an empty stream
+ */
+std::unique_ptr<hasher_t> make_hasher(hash_algorithm_t algorithm);
+
+/**
+ * Get the name of a hash function, as given to --hash.
+ * @param algorithm The hash function
+ * @return Its name
+ */
+const char *hash_name(hash_algorithm_t algorithm);
+
+/**
+ * Find a hash function by name.
+ * @param name Name of the hash function, as given to --hash
+ * @param algorithm Receives the hash function
+ * @return False if there is no hash function of that name
+ */
+bool hash_from_name(const std::string &name, hash_algorithm_t &algorithm);
+
+//  The hash function of content keys (see --hash)
+extern hash_algorithm_t gContentHash;
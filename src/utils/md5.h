@@ -90,6 +90,12 @@ public:
   /* Construct a MD5 object with a string. */
   MD5(const std::string& message);
 
+  /* Construct a MD5 object of an empty message, extended with update. */
+  MD5();
+
+  /* Append bytes to the message. */
+  void update(const byte* input, size_t len);
+
   /* Generate md5 digest. */
   const byte* getDigest();
 
@@ -164,6 +170,29 @@ inline MD5::MD5(const std::string& message) {
   init((const byte*)message.c_str(), message.length());
 }
 
+/**
+ * @Construct a MD5 object of an empty message.
+ *
+ */
+inline MD5::MD5() : MD5(std::string()) {}
+
+/**
+ * @Append bytes to the message.
+ *
+ * @param {input} the bytes.
+ *
+ * @param {len} the number of bytes.
+ *
+ */
+inline void MD5::update(const byte* input, size_t len) {
+  /* init counts the bits of a call in 32 bits */
+  const size_t max_len = 1 << 28;
+  for (; len > max_len; input += max_len, len -= max_len) {
+    init(input, max_len);
+  }
+  init(input, len);
+}
+
 /**
  * @Generate md5 digest.
  *
@@ -0,0 +1,22 @@
+//  The 8 lanes kernel of md5_multi_t, built for AVX2 whatever the target of the other files
+//  md5_multi_t only calls it when the CPU has AVX2
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#pragma GCC push_options
+#pragma GCC target("avx2")
+
+#include "utils/md5_lanes.h"
+
+void md5_transform_avx2(uint32_t *state, const uint8_t *const *blocks)
+{
+    md5_lanes_transform<md5_v8_t, 8>(state, blocks);
+}
+
+#pragma GCC pop_options
+
+#endif
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+//  MD5 transform of one block of each of several messages, one message per lane of a vector
+//  This header is only included by the translation units of the kernels of md5_multi_t,
+//  each compiled for its instruction set: its definitions have internal linkage, so the linker
+//  never picks an AVX2 instance for a caller that runs on a CPU without AVX2
+
+namespace
+{
+
+typedef uint32_t md5_v4_t __attribute__((vector_size(16)));
+typedef uint32_t md5_v8_t __attribute__((vector_size(32)));
+
+const uint32_t md5_lanes_k[64] = {
+    0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+    0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+    0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+    0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+    0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+    0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+    0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+    0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391,
+};
+
+const int md5_lanes_shift[4][4] = {{7, 12, 17, 22}, {5, 9, 14, 20}, {4, 11, 16, 23}, {6, 10, 15, 21}};
+
+inline uint32_t md5_lanes_load(const uint8_t *bytes)
+{
+    uint32_t word;
+    std::memcpy(&word, bytes, sizeof(word));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    word = __builtin_bswap32(word);
+#endif
+    return word;
+}
+
+template <typename V>
+inline V md5_lanes_rotate(V x, int n)
+{
+    return (x << n) | (x >> (32 - n));
+}
+
+//  One step: a = b + ((a + f + k + m) <<< s), then the registers rotate
+template <typename V>
+inline void md5_lanes_step(V &a, V &b, V &c, V &d, V f, int i, V m, int s)
+{
+    V t = a + f + md5_lanes_k[i] + m;
+    a = d;
+    d = c;
+    c = b;
+    b = b + md5_lanes_rotate(t, s);
+}
+
+/**
+ * Transform one block of each lane.
+ * @param state The state of each lane, word by word (state[lane] is A, state[N + lane] is B...)
+ * @param blocks The 64 bytes block of each lane
+ */
+template <typename V, size_t N>
+inline void md5_lanes_transform(uint32_t *state, const uint8_t *const *blocks)
+{
+    V m[16];
+    for (int j = 0; j < 16; j++)
+    {
+        for (size_t lane = 0; lane < N; lane++)
+        {
+            m[j][lane] = md5_lanes_load(blocks[lane] + 4 * j);
+        }
+    }
+
+    V a, b, c, d;
+    for (size_t lane = 0; lane < N; lane++)
+    {
+        a[lane] = state[lane];
+        b[lane] = state[N + lane];
+        c[lane] = state[2 * N + lane];
+        d[lane] = state[3 * N + lane];
+    }
+    V aa = a, bb = b, cc = c, dd = d;
+
+#pragma GCC unroll 16
+    for (int i = 0; i < 16; i++)
+    {
+        md5_lanes_step(a, b, c, d, d ^ (b & (c ^ d)), i, m[i], md5_lanes_shift[0][i % 4]);
+    }
+#pragma GCC unroll 16
+    for (int i = 16; i < 32; i++)
+    {
+        md5_lanes_step(a, b, c, d, c ^ (d & (b ^ c)), i, m[(5 * i + 1) % 16], md5_lanes_shift[1][i % 4]);
+    }
+#pragma GCC unroll 16
+    for (int i = 32; i < 48; i++)
+    {
+        md5_lanes_step(a, b, c, d, b ^ c ^ d, i, m[(3 * i + 5) % 16], md5_lanes_shift[2][i % 4]);
+    }
+#pragma GCC unroll 16
+    for (int i = 48; i < 64; i++)
+    {
+        md5_lanes_step(a, b, c, d, c ^ (b | ~d), i, m[(7 * i) % 16], md5_lanes_shift[3][i % 4]);
+    }
+
+    a += aa;
+    b += bb;
+    c += cc;
+    d += dd;
+    for (size_t lane = 0; lane < N; lane++)
+    {
+        state[lane] = a[lane];
+        state[N + lane] = b[lane];
+        state[2 * N + lane] = c[lane];
+        state[3 * N + lane] = d[lane];
+    }
+}
+
+} // namespace
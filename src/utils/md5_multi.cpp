@@ -0,0 +1,146 @@
+#include "utils/md5_multi.h"
+#include "utils/md5_lanes.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(__i386__)
+//  Defined in md5_avx2.cpp
+void md5_transform_avx2(uint32_t *state, const uint8_t *const *blocks);
+#endif
+
+namespace
+{
+
+//  SSE2 is part of x86-64, so the 4 lanes kernel needs no runtime check
+void md5_transform_sse2(uint32_t *state, const uint8_t *const *blocks)
+{
+    md5_lanes_transform<md5_v4_t, 4>(state, blocks);
+}
+
+struct md5_kernel_t
+{
+    const char *name;
+    size_t lanes;
+    void (*transform)(uint32_t *state, const uint8_t *const *blocks);
+};
+
+const md5_kernel_t &md5_kernel()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    static const md5_kernel_t kernel = __builtin_cpu_supports("avx2") ? md5_kernel_t{"avx2", 8, md5_transform_avx2}
+                                                                      : md5_kernel_t{"sse2", 4, md5_transform_sse2};
+#else
+    static const md5_kernel_t kernel = {"generic", 4, md5_transform_sse2};
+#endif
+    return kernel;
+}
+
+const uint8_t md5_padding[64] = {0x80};
+const uint8_t md5_idle_block[64] = {}; // Block of the lanes that have nothing to transform, whose result is dropped
+const char md5_hex[] = "0123456789abcdef";
+
+} // namespace
+
+size_t md5_multi_t::lanes()
+{
+    return md5_kernel().lanes;
+}
+
+const char *md5_multi_t::engine()
+{
+    return md5_kernel().name;
+}
+
+md5_multi_t::md5_multi_t(size_t count)
+    : count_(count), state_(count, {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476}), pending_(count), length_(count)
+{
+    if (count == 0 || count > lanes())
+    {
+        throw std::invalid_argument("md5_multi_t: invalid number of messages");
+    }
+}
+
+void md5_multi_t::update(size_t lane, const void *data, size_t size)
+{
+    auto bytes = static_cast<const uint8_t *>(data);
+    pending_[lane].insert(pending_[lane].end(), bytes, bytes + size);
+    length_[lane] += size;
+}
+
+void md5_multi_t::flush()
+{
+    const auto &kernel = md5_kernel();
+    std::vector<uint32_t> state(4 * kernel.lanes);
+    std::vector<const uint8_t *> blocks(kernel.lanes, md5_idle_block);
+
+    size_t rounds = 0;
+    for (const auto &pending : pending_)
+    {
+        rounds = std::max(rounds, pending.size() / 64);
+    }
+
+    //  Lanes with fewer blocks are idle for the last rounds
+    for (size_t round = 0; round != rounds; round++)
+    {
+        for (size_t lane = 0; lane != count_; lane++)
+        {
+            bool active = (round + 1) * 64 <= pending_[lane].size();
+            blocks[lane] = active ? pending_[lane].data() + round * 64 : md5_idle_block;
+            for (size_t word = 0; word != 4; word++)
+            {
+                state[word * kernel.lanes + lane] = state_[lane][word];
+            }
+        }
+        kernel.transform(state.data(), blocks.data());
+        for (size_t lane = 0; lane != count_; lane++)
+        {
+            if (blocks[lane] != md5_idle_block)
+            {
+                for (size_t word = 0; word != 4; word++)
+                {
+                    state_[lane][word] = state[word * kernel.lanes + lane];
+                }
+            }
+        }
+    }
+
+    for (auto &pending : pending_)
+    {
+        pending.erase(pending.begin(), pending.begin() + pending.size() / 64 * 64);
+    }
+}
+
+std::vector<std::string> md5_multi_t::digests()
+{
+    //  Padding up to 56 bytes modulo 64, then the length in bits, little endian
+    for (size_t lane = 0; lane != count_; lane++)
+    {
+        uint64_t bits = length_[lane] * 8;
+        size_t used = pending_[lane].size() % 64;
+        size_t padding = used < 56 ? 56 - used : 120 - used;
+        pending_[lane].insert(pending_[lane].end(), md5_padding, md5_padding + padding);
+        for (int i = 0; i != 8; i++)
+        {
+            pending_[lane].push_back(static_cast<uint8_t>(bits >> (8 * i)));
+        }
+    }
+    flush();
+
+    std::vector<std::string> result;
+    for (const auto &state : state_)
+    {
+        std::string digest;
+        for (auto word : state)
+        {
+            for (int i = 0; i != 4; i++)
+            {
+                uint8_t byte = static_cast<uint8_t>(word >> (8 * i));
+                digest += md5_hex[byte >> 4];
+                digest += md5_hex[byte & 15];
+            }
+        }
+        result.push_back(digest);
+    }
+    return result;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * MD5 of several messages at once, one message per lane of the SIMD registers (multi-buffer hashing).
+ * The lanes run the MD5 transform in lockstep, so a batch costs about as much as one message
+ * when the messages have the same size. The results are the same as the ones of the MD5 class.
+ *
+ * The kernel is selected at runtime: 8 lanes with AVX2 when the CPU has it, 4 lanes with SSE2 otherwise.
+ * Bytes are buffered per lane until flush() or digests(), which transform the complete blocks:
+ * lanes fed the same number of bytes between flushes keep the kernel busy, and the memory
+ * used is the bytes fed between two flushes.
+ */
+class md5_multi_t
+{
+    size_t count_;
+    std::vector<std::array<uint32_t, 4>> state_; // A, B, C, D of each message
+    std::vector<std::vector<uint8_t>> pending_;  // Bytes of each message not transformed yet
+    std::vector<uint64_t> length_;               // Bytes of each message
+
+public:
+    /**
+     * Get the number of lanes of the kernel of this CPU.
+     * @return The most messages of a batch
+     */
+    static size_t lanes();
+
+    /**
+     * Get the name of the kernel of this CPU.
+     * @return "avx2", "sse2", or "generic" if the CPU is not an x86
+     */
+    static const char *engine();
+
+    /**
+     * Start hashing empty messages.
+     * @param count Number of messages, from 1 to lanes()
+     * @throws std::invalid_argument if count is out of range
+     */
+    explicit md5_multi_t(size_t count);
+
+    /**
+     * Append bytes to a message.
+     * @param lane The message
+     * @param data The bytes
+     * @param size Number of bytes
+     */
+    void update(size_t lane, const void *data, size_t size);
+
+    /**
+     * Transform the complete blocks of all messages.
+     */
+    void flush();
+
+    /**
+     * Finish the messages.
+     * @return The MD5 of each message, as lowercase hexadecimal
+     */
+    std::vector<std::string> digests();
+};
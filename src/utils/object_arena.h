@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * Monotonic storage of objects.
+ * Objects are constructed one after the other in large chunks, and are all destroyed with the arena,
+ * so building millions of objects costs one allocation per chunk instead of one per object,
+ * and releasing them frees a few chunks.
+ * Pointers between objects of the same arena stay valid as long as the arena, so the objects
+ * refer to each other with plain pointers, and shared pointers to them share the ownership
+ * of the arena (see handle).
+ * The arena is not thread-safe: it is filled by the thread that mounts its partition.
+ */
+class object_arena_t
+{
+    //  Chunks grow geometrically from the first one, so small partitions stay small
+    static const size_t first_chunk_size = 4 * 1024;
+
+    std::pmr::monotonic_buffer_resource resource_{first_chunk_size};
+
+    //  Objects that have a destructor, in construction order
+    struct destructor_t
+    {
+        void *object;
+        void (*destroy)(void *);
+    };
+    std::vector<destructor_t> destructors_;
+
+public:
+    object_arena_t() = default;
+    object_arena_t(const object_arena_t &) = delete;
+    object_arena_t &operator=(const object_arena_t &) = delete;
+
+    //  The objects are destroyed in reverse order, then the chunks are freed
+    ~object_arena_t()
+    {
+        for (auto it = destructors_.rbegin(); it != destructors_.rend(); ++it)
+        {
+            it->destroy(it->object);
+        }
+    }
+
+    /**
+     * Construct an object in the arena.
+     * @param args The arguments of the constructor
+     * @return The object, valid as long as the arena
+     */
+    template <typename T, typename... Args>
+    T *make(Args &&...args)
+    {
+        void *memory = resource_.allocate(sizeof(T), alignof(T));
+        T *object = ::new (memory) T(std::forward<Args>(args)...);
+        if constexpr (!std::is_trivially_destructible_v<T>)
+        {
+            destructors_.push_back({object, [](void *object)
+                                    { static_cast<T *>(object)->~T(); }});
+        }
+        return object;
+    }
+
+    //  For the containers of the objects, ie: std::pmr::vector
+    std::pmr::memory_resource *resource() { return &resource_; }
+
+    /**
+     * Get a shared pointer to an object of an arena.
+     * The pointer shares the ownership of the whole arena, no memory is allocated.
+     * @param arena The arena
+     * @param object An object of the arena
+     * @return The shared pointer
+     */
+    template <typename T>
+    static std::shared_ptr<T> handle(const std::shared_ptr<object_arena_t> &arena, T *object)
+    {
+        return std::shared_ptr<T>(arena, object);
+    }
+};
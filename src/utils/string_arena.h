@@ -0,0 +1,57 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+/**
+ * Monotonic storage of strings.
+ * Strings are copied one after the other in large chunks, and are only freed with the arena,
+ * so storing millions of short names costs one allocation per chunk instead of one or two per name.
+ * The arena is not thread-safe: it is filled by the thread that mounts its partition.
+ */
+class string_arena_t
+{
+    //  Chunks double in size from the first to the largest, so small partitions stay small
+    static const size_t first_chunk_size = 1024;
+    static const size_t chunk_size = 64 * 1024;
+
+    std::vector<std::unique_ptr<char[]>> chunks_;
+    std::vector<std::unique_ptr<char[]>> large_;
+    size_t capacity_ = 0; // Size of the last chunk
+    size_t used_ = 0;     // Bytes used in the last chunk
+
+public:
+    /**
+     * Copy a string into the arena.
+     * @param string The string
+     * @return The copy, valid as long as the arena
+     */
+    std::string_view store(std::string_view string)
+    {
+        if (string.empty())
+        {
+            return {};
+        }
+        //  Large strings get a block of their own, so they do not waste the end of a chunk
+        if (string.size() > first_chunk_size / 4)
+        {
+            large_.push_back(std::make_unique_for_overwrite<char[]>(string.size()));
+            std::memcpy(large_.back().get(), string.data(), string.size());
+            return {large_.back().get(), string.size()};
+        }
+        if (string.size() > capacity_ - used_)
+        {
+            capacity_ = std::clamp(capacity_ * 2, first_chunk_size, chunk_size);
+            chunks_.push_back(std::make_unique_for_overwrite<char[]>(capacity_));
+            used_ = 0;
+        }
+        char *copy = chunks_.back().get() + used_;
+        std::memcpy(copy, string.data(), string.size());
+        used_ += string.size();
+        return {copy, string.size()};
+    }
+};
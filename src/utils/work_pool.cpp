@@ -0,0 +1,113 @@
+#include "utils/work_pool.h"
+
+#include <algorithm>
+
+//  Index of the worker running on the current thread, or SIZE_MAX outside of any pool
+static thread_local size_t current_worker = SIZE_MAX;
+static thread_local const work_pool_t *current_pool = nullptr;
+
+work_pool_t::work_pool_t(size_t thread_count)
+{
+    thread_count = std::max<size_t>(thread_count, 1);
+    for (size_t i = 0; i != thread_count; i++)
+    {
+        workers_.push_back(std::make_unique<worker_t>());
+    }
+    for (size_t i = 0; i != thread_count; i++)
+    {
+        threads_.emplace_back([this, i]
+                              { run(i); });
+    }
+}
+
+work_pool_t::~work_pool_t()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    condition_.notify_all();
+    for (auto &thread : threads_)
+    {
+        thread.join();
+    }
+}
+
+void work_pool_t::submit(std::function<void()> task)
+{
+    size_t index = current_worker;
+    if (current_pool != this)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        index = next_worker_++ % workers_.size();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(workers_[index]->mutex);
+        workers_[index]->tasks.push_back(std::move(task));
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending_++;
+    }
+    condition_.notify_one();
+}
+
+//  Takes the newest task of the worker, or steals the oldest task of another one
+bool work_pool_t::take(size_t index, std::function<void()> &task)
+{
+    for (size_t i = 0; i != workers_.size(); i++)
+    {
+        auto &worker = *workers_[(index + i) % workers_.size()];
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        if (worker.tasks.empty())
+        {
+            continue;
+        }
+        if (i == 0)
+        {
+            task = std::move(worker.tasks.back());
+            worker.tasks.pop_back();
+        }
+        else
+        {
+            task = std::move(worker.tasks.front());
+            worker.tasks.pop_front();
+        }
+        return true;
+    }
+    return false;
+}
+
+void work_pool_t::run(size_t index)
+{
+    current_worker = index;
+    current_pool = this;
+
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            condition_.wait(lock, [this]
+                            { return pending_ > 0 || stopping_; });
+            if (pending_ == 0)
+            {
+                return;
+            }
+            //  Claim a task: pending_ is only incremented once the task is in a deque,
+            //  so the deques hold at least one task that no other worker claimed
+            pending_--;
+        }
+
+        //  A pass over the deques can miss the claimed task: another worker may take a task
+        //  from a deque this pass has yet to check, while a new task lands in one it already checked.
+        //  Claims never outnumber the queued tasks, so retrying always ends with a task
+        std::function<void()> task;
+        while (!take(index, task))
+        {
+            std::this_thread::yield();
+        }
+        task();
+    }
+}
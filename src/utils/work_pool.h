@@ -0,0 +1,66 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Work-stealing thread pool.
+ * Each worker has its own task deque: it runs its newest task first,
+ * and when its deque is empty it steals the oldest task of another worker.
+ * Tasks submitted from a worker go to the deque of that worker, so a task
+ * that splits its work (ie: an image into partitions) keeps it local unless
+ * other workers are idle.
+ */
+class work_pool_t
+{
+    struct worker_t
+    {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    std::vector<std::unique_ptr<worker_t>> workers_;
+    std::vector<std::thread> threads_;
+
+    std::mutex mutex_;                  // Protects pending_ and stopping_
+    std::condition_variable condition_; // Signaled when a task is submitted or when stopping
+    size_t pending_ = 0;                // Number of tasks waiting in the deques
+    bool stopping_ = false;
+    size_t next_worker_ = 0;            // Round-robin target for tasks submitted from outside the pool
+
+    void run(size_t index);
+    bool take(size_t index, std::function<void()> &task);
+
+public:
+    /**
+     * Start the worker threads.
+     * @param thread_count Number of workers (at least 1)
+     */
+    explicit work_pool_t(size_t thread_count);
+
+    /**
+     * Run the remaining tasks and join the worker threads.
+     */
+    ~work_pool_t();
+
+    work_pool_t(const work_pool_t &) = delete;
+    work_pool_t &operator=(const work_pool_t &) = delete;
+
+    /**
+     * Queue a task. Tasks must not throw.
+     * @param task The task to run on one of the workers
+     */
+    void submit(std::function<void()> task);
+
+    /**
+     * Get the number of worker threads.
+     * @return Number of workers
+     */
+    size_t size() const { return workers_.size(); }
+};
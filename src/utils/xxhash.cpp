@@ -0,0 +1,131 @@
+#include "utils/xxhash.h"
+
+#include <algorithm>
+#include <cstring>
+
+static const uint64_t PRIME64_1 = 0x9E3779B185EBCA87ULL;
+static const uint64_t PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+static const uint64_t PRIME64_3 = 0x165667B19E3779F9ULL;
+static const uint64_t PRIME64_4 = 0x85EBCA77C2B2AE63ULL;
+static const uint64_t PRIME64_5 = 0x27D4EB2F165667C5ULL;
+
+static inline uint64_t rotl(uint64_t value, int bits)
+{
+    return (value << bits) | (value >> (64 - bits));
+}
+
+//  Input words are little-endian
+static inline uint64_t read64(const uint8_t *p)
+{
+    return uint64_t(p[0]) | uint64_t(p[1]) << 8 | uint64_t(p[2]) << 16 | uint64_t(p[3]) << 24 |
+           uint64_t(p[4]) << 32 | uint64_t(p[5]) << 40 | uint64_t(p[6]) << 48 | uint64_t(p[7]) << 56;
+}
+
+static inline uint32_t read32(const uint8_t *p)
+{
+    return uint32_t(p[0]) | uint32_t(p[1]) << 8 | uint32_t(p[2]) << 16 | uint32_t(p[3]) << 24;
+}
+
+static inline uint64_t xxh_round(uint64_t accumulator, uint64_t input)
+{
+    accumulator += input * PRIME64_2;
+    accumulator = rotl(accumulator, 31);
+    return accumulator * PRIME64_1;
+}
+
+static inline uint64_t merge_round(uint64_t hash, uint64_t accumulator)
+{
+    hash ^= xxh_round(0, accumulator);
+    return hash * PRIME64_1 + PRIME64_4;
+}
+
+xxh64_t::xxh64_t(uint64_t seed) : seed_(seed)
+{
+    v_[0] = seed + PRIME64_1 + PRIME64_2;
+    v_[1] = seed + PRIME64_2;
+    v_[2] = seed;
+    v_[3] = seed - PRIME64_1;
+}
+
+void xxh64_t::update(const void *data, size_t size)
+{
+    auto p = static_cast<const uint8_t *>(data);
+    auto end = p + size;
+    length_ += size;
+
+    //  Complete the buffered stripe first
+    if (buffered_)
+    {
+        size_t count = std::min(size, sizeof(buffer_) - buffered_);
+        std::memcpy(buffer_ + buffered_, p, count);
+        buffered_ += count;
+        p += count;
+        if (buffered_ < sizeof(buffer_))
+        {
+            return;
+        }
+        for (int i = 0; i != 4; i++)
+        {
+            v_[i] = xxh_round(v_[i], read64(buffer_ + 8 * i));
+        }
+        buffered_ = 0;
+    }
+
+    uint64_t v0 = v_[0], v1 = v_[1], v2 = v_[2], v3 = v_[3];
+    for (; end - p >= 32; p += 32)
+    {
+        v0 = xxh_round(v0, read64(p));
+        v1 = xxh_round(v1, read64(p + 8));
+        v2 = xxh_round(v2, read64(p + 16));
+        v3 = xxh_round(v3, read64(p + 24));
+    }
+    v_[0] = v0, v_[1] = v1, v_[2] = v2, v_[3] = v3;
+
+    std::memcpy(buffer_, p, end - p);
+    buffered_ = end - p;
+}
+
+uint64_t xxh64_t::digest() const
+{
+    uint64_t hash;
+    if (length_ >= 32)
+    {
+        hash = rotl(v_[0], 1) + rotl(v_[1], 7) + rotl(v_[2], 12) + rotl(v_[3], 18);
+        for (int i = 0; i != 4; i++)
+        {
+            hash = merge_round(hash, v_[i]);
+        }
+    }
+    else
+    {
+        hash = seed_ + PRIME64_5;
+    }
+    hash += length_;
+
+    //  The bytes after the last stripe
+    const uint8_t *p = buffer_;
+    const uint8_t *end = buffer_ + buffered_;
+    for (; end - p >= 8; p += 8)
+    {
+        hash ^= xxh_round(0, read64(p));
+        hash = rotl(hash, 27) * PRIME64_1 + PRIME64_4;
+    }
+    if (end - p >= 4)
+    {
+        hash ^= uint64_t(read32(p)) * PRIME64_1;
+        hash = rotl(hash, 23) * PRIME64_2 + PRIME64_3;
+        p += 4;
+    }
+    for (; p != end; p++)
+    {
+        hash ^= *p * PRIME64_5;
+        hash = rotl(hash, 11) * PRIME64_1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= PRIME64_2;
+    hash ^= hash >> 29;
+    hash *= PRIME64_3;
+    hash ^= hash >> 32;
+    return hash;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Streaming XXH64 (xxHash, 64 bits), a fast non-cryptographic hash.
+ * Its values are the ones of the reference implementation, for any split of the input into updates.
+ */
+class xxh64_t
+{
+    uint64_t v_[4];       // Accumulators of the 32 bytes stripes
+    uint8_t buffer_[32];  // Start of an incomplete stripe
+    size_t buffered_ = 0; // Number of bytes in buffer_
+    uint64_t length_ = 0; // Number of bytes hashed
+    uint64_t seed_;
+
+public:
+    explicit xxh64_t(uint64_t seed = 0);
+
+    /**
+     * Hash the next bytes.
+     * @param data The bytes
+     * @param size Number of bytes
+     */
+    void update(const void *data, size_t size);
+
+    /**
+     * Get the hash of the bytes hashed so far, more bytes can be hashed after.
+     * @return The hash
+     */
+    uint64_t digest() const;
+};